@@ -1,26 +1,154 @@
+// ADSR envelopes for a bank of voices, rendered a block at a time.
+//
+// Every stage is a segment with a closed form. The attack rises
+// exponentially towards 1.5 and ends when it reaches 1. Decay (towards the
+// sustain level) and release (towards 0) fall exponentially with shape 0. With
+// shape s > 0 they follow the power curve dv/dt = -rate * v^(s + 1), which
+// slows down as v gets small.
+//
+// A segment is planned per voice as value = value * mul + add, clamped to 1,
+// with the number of frames until it ends. adsr_env_render then runs the
+// frames of all voices side by side, which vectorizes across voices, and
+// replans a voice only when its segment ends: at the end of the attack, and
+// every ADSR_ENV_CURVE_FRAMES frames along a power curve, which is followed by
+// the exponential through its value at the end of that run. Gate changes
+// (adsr_env_trigger, adsr_env_release) and parameter edits (adsr_env_set)
+// replan too. Rates are per second, as before.
+//
+//   static struct adsr_env env;
+//   adsr_env_init(&env, NUM_VOICES, dt, 0);
+//   adsr_env_set(&env, attack, decay, sustain, release);  // when a CC changes
+//   adsr_env_trigger(&env, v);                            // note on
+//   adsr_env_release(&env, v);                            // note off
+//   ...
+//   static double out[BLOCK_SIZE][ADSR_ENV_MAX_VOICES];
+//   adsr_env_render(&env, out, nframes);                  // out[i][v]
+
+#include <limits.h>
+
+#define ADSR_ENV_MAX_VOICES 16
+#define ADSR_ENV_CURVE_FRAMES 32
+
+enum adsr_env_stage { ADSR_ENV_ATTACK, ADSR_ENV_DECAY, ADSR_ENV_RELEASE };
+
 struct adsr_env {
-  bool in_attack;
-  double value;
+  int num_voices;
+  int shape;
+  double dt;
+  double attack, decay, sustain, release;
+  // per voice, side by side for the render loop
+  double value[ADSR_ENV_MAX_VOICES];
+  double mul[ADSR_ENV_MAX_VOICES];
+  double add[ADSR_ENV_MAX_VOICES];
+  int frames_left[ADSR_ENV_MAX_VOICES];
+  char stage[ADSR_ENV_MAX_VOICES];
 };
 
-static inline double adsr_env_tick(struct adsr_env *adsr_env, double dt, double attack, double decay, double sustain, double release, double gate, int shape) {
-  if (gate > 0) {
-    if (adsr_env->in_attack) {
-      adsr_env->value += dt * attack * (1.5 - adsr_env->value);
-      if (adsr_env->value >= 1.0) {
-	adsr_env->value = 1.0;
-	adsr_env->in_attack = false;
-      }
+// Ratio per frame of a fall towards target at the given rate
+static inline double adsr_env_ratio(struct adsr_env *e, double v0, double target, double rate, int *frames) {
+  double k = e->dt * rate;
+  if (e->shape == 0) {
+    *frames = INT_MAX;
+    return fmax(0.5, fmin(1.0, 1 - k));
+  }
+  // v(n) = v0 * (1 + s * k * v0^s * n)^(-1/s), matched at the end of the run
+  double s = e->shape;
+  *frames = ADSR_ENV_CURVE_FRAMES;
+  double growth = 1 + s * k * pow(fabs(v0 - target), s) * ADSR_ENV_CURVE_FRAMES;
+  return fmax(0.5, pow(growth, -1 / (s * ADSR_ENV_CURVE_FRAMES)));
+}
+
+static inline void adsr_env_plan(struct adsr_env *e, int v) {
+  double v0 = e->value[v];
+  double r, target;
+  int frames;
+  switch (e->stage[v]) {
+  case ADSR_ENV_ATTACK:
+    r = 1 - e->dt * e->attack;
+    target = 1.5;
+    if (v0 >= 1 || r <= 0) {
+      frames = 1;
+    } else if (r >= 1) {
+      frames = INT_MAX;
     } else {
-      double v = adsr_env->value - sustain;
-      adsr_env->value = sustain + v * fmax(0.5, fmin(1.0, 1 - dt * decay * pow(v, shape)));
+      // 1.5 - (1.5 - v0) * r^n reaches 1
+      frames = (int) fmin(INT_MAX, fmax(1, ceil(log(0.5 / (1.5 - v0)) / log(r))));
     }
-  } else {
-    adsr_env->value *= fmax(0.5, 1 - dt * release * pow(adsr_env->value, shape));
+    break;
+  case ADSR_ENV_DECAY:
+    target = e->sustain;
+    r = adsr_env_ratio(e, v0, target, e->decay, &frames);
+    break;
+  default:
+    target = 0;
+    r = adsr_env_ratio(e, v0, target, e->release, &frames);
+    break;
+  }
+  e->mul[v] = r;
+  e->add[v] = target * (1 - r);
+  e->frames_left[v] = frames;
+}
+
+// The segment of voice v ended
+static inline void adsr_env_next(struct adsr_env *e, int v) {
+  if (e->stage[v] == ADSR_ENV_ATTACK) {
+    e->value[v] = 1.0;
+    e->stage[v] = ADSR_ENV_DECAY;
   }
-  return adsr_env->value;
+  adsr_env_plan(e, v);
 }
 
-static inline void adsr_env_trigger(struct adsr_env *adsr_env) {
-  adsr_env->in_attack = true;
+static inline void adsr_env_init(struct adsr_env *e, int num_voices, double dt, int shape) {
+  e->num_voices = num_voices;
+  e->shape = shape;
+  e->dt = dt;
+  FOR(v, num_voices) {
+    e->value[v] = 0;
+    e->stage[v] = ADSR_ENV_RELEASE;
+    adsr_env_plan(e, v);
+  }
+}
+
+static inline void adsr_env_set(struct adsr_env *e, double attack, double decay, double sustain, double release) {
+  if (attack == e->attack && decay == e->decay && sustain == e->sustain && release == e->release) return;
+  e->attack = attack;
+  e->decay = decay;
+  e->sustain = sustain;
+  e->release = release;
+  FOR(v, e->num_voices) adsr_env_plan(e, v);
+}
+
+// Attack from the current value
+static inline void adsr_env_trigger(struct adsr_env *e, int v) {
+  e->stage[v] = ADSR_ENV_ATTACK;
+  adsr_env_plan(e, v);
+}
+
+static inline void adsr_env_release(struct adsr_env *e, int v) {
+  e->stage[v] = ADSR_ENV_RELEASE;
+  adsr_env_plan(e, v);
+}
+
+static inline void adsr_env_render(struct adsr_env *e, double (*out)[ADSR_ENV_MAX_VOICES], int nframes) {
+  int n = e->num_voices;
+  for (int start = 0; start < nframes; ) {
+    int run = nframes - start;
+    FOR(v, n) if (e->frames_left[v] < run) run = e->frames_left[v];
+    // local copies, which out cannot alias
+    double value[ADSR_ENV_MAX_VOICES], mul[ADSR_ENV_MAX_VOICES], add[ADSR_ENV_MAX_VOICES];
+    FOR(v, n) {
+      value[v] = e->value[v];
+      mul[v] = e->mul[v];
+      add[v] = e->add[v];
+    }
+    for (int i = start; i < start + run; i++) {
+      FOR(v, n) out[i][v] = value[v] = fmin(1.0, value[v] * mul[v] + add[v]);
+    }
+    FOR(v, n) {
+      e->value[v] = value[v];
+      e->frames_left[v] -= run;
+      if (e->frames_left[v] == 0) adsr_env_next(e, v);
+    }
+    start += run;
+  }
 }
@@ -1,3 +1,5 @@
+// freq is the cutoff over the sample rate, so ap_coeff can also build a
+// prewarp.h table.
 static inline double ap_coeff(double freq) {
     /*
 
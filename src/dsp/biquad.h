@@ -62,28 +62,174 @@ static inline struct biquad_coeffs biquad_invert(struct biquad_coeffs _) {
   };
 }
 
+// Coefficients divided by a0, for the kernels below. Normalize once when the
+// parameters change instead of dividing by a0 on every sample.
+struct biquad_norm {
+  double b0, b1, b2;
+  double a1, a2;
+};
+
+static inline struct biquad_norm biquad_normalize(struct biquad_coeffs c) {
+  double r = 1 / c.a0;
+  return (struct biquad_norm) {
+    .b0 = c.b0 * r, .b1 = c.b1 * r, .b2 = c.b2 * r,
+    .a1 = c.a1 * r, .a2 = c.a2 * r,
+  };
+}
+
+// Transposed direct form II: two state variables per filter instead of the
+// four of direct form I.
 struct biquad_state {
-  double x1, x2;
-  double y1, y2;
+  double s1, s2;
 };
 
-static inline void biquad_process(struct biquad_coeffs c, struct biquad_state *s, const float *in, float *out, int n) {
+static inline double biquad_norm_tick(const struct biquad_norm *c, struct biquad_state *s, double x) {
+  double y = c->b0 * x + s->s1;
+  s->s1 = c->b1 * x - c->a1 * y + s->s2;
+  s->s2 = c->b2 * x - c->a2 * y;
+  return y;
+}
+
+static inline void biquad_norm_process(const struct biquad_norm *c, struct biquad_state *s, const float *in, float *out, int n) {
+  struct biquad_norm k = *c;
+  struct biquad_state t = *s;
+  FOR(i, n) out[i] = biquad_norm_tick(&k, &t, in[i]);
+  *s = t;
+}
+
+// Moves the coefficients linearly from *from to *to across the n frames. For
+// parameters that change from block to block: the filter follows without a
+// zipper step and without computing coefficients per frame.
+static inline void biquad_norm_process_ramp(const struct biquad_norm *from, const struct biquad_norm *to,
+					    struct biquad_state *s, const float *in, float *out, int n) {
+  struct biquad_norm k = *from;
+  struct biquad_state t = *s;
+  double r = 1.0 / n;
+  struct biquad_norm dk = {
+    .b0 = (to->b0 - k.b0) * r, .b1 = (to->b1 - k.b1) * r, .b2 = (to->b2 - k.b2) * r,
+    .a1 = (to->a1 - k.a1) * r, .a2 = (to->a2 - k.a2) * r,
+  };
   FOR(i, n) {
-    double x0 = in[i];
-    double y0 =
-      (1 / c.a0)
-      * (+ c.b0 * x0
-	 + c.b1 * s->x1
-	 + c.b2 * s->x2
-	 - c.a1 * s->y1
-	 - c.a2 * s->y2);
-    out[i] = y0;
-    s->x2 = s->x1; s->x1 = x0;
-    s->y2 = s->y1; s->y1 = y0;
+    out[i] = biquad_norm_tick(&k, &t, in[i]);
+    k.b0 += dk.b0; k.b1 += dk.b1; k.b2 += dk.b2;
+    k.a1 += dk.a1; k.a2 += dk.a2;
   }
+  *s = t;
 }
+
+// For coefficients that are computed anew for every block.
+static inline void biquad_process(struct biquad_coeffs c, struct biquad_state *s, const float *in, float *out, int n) {
+  struct biquad_norm k = biquad_normalize(c);
+  biquad_norm_process(&k, s, in, out, n);
+}
+
 static inline float biquad_tick(struct biquad_coeffs c, struct biquad_state *state, float in) {
-  float out;
-  biquad_process(c, state, &in, &out, 1);
-  return out;
+  struct biquad_norm k = biquad_normalize(c);
+  return biquad_norm_tick(&k, state, in);
 }
+
+// Independent filters in the lanes of one struct: the channels of a bus, or
+// parallel filters on one signal. The coefficients and states are GCC vector
+// types, so a frame is one vector operation per coefficient for all lanes;
+// without wide enough registers GCC splits them. name_process interleaves
+// BIQUAD_CHUNK frames of the lanes' buffers into one array of vectors at a
+// time, filters it and splits it back. BIQUAD_LANES(name, type, lanes)
+// defines
+//
+//   name_v                 the vector of lanes, indexable like an array
+//   struct name_coeffs, struct name_state
+//   name_set(&coeffs, lane, biquad_norm)
+//   name_tick(&coeffs, &state, &x, &y)
+//   name_process(&coeffs, &state, in[lanes], out[lanes], nframes)
+//   name_process_ramp(&from, &to, &state, in[lanes], out[lanes], nframes)
+//   name_ramp(&delta, &from, &to, nframes), name_advance(&coeffs, &delta)
+//
+// The _ramp variants move the coefficients linearly across the frames, as
+// biquad_norm_process_ramp does; name_ramp and name_advance are the same for
+// code that calls name_tick itself.
+//
+// for biquad{2,4,8}d (double) and biquad{2,4,8}f (float). Lanes that are not
+// set have zero coefficients and output silence; process still needs
+// buffers for them. in and out may be the same buffers, and so may x and y.
+
+#define BIQUAD_CHUNK 64
+
+#define BIQUAD_LANES(name, type, lanes)					\
+  typedef type name##_v __attribute__((vector_size(lanes * sizeof(type)))); \
+									\
+  struct name##_coeffs {						\
+    name##_v b0, b1, b2;						\
+    name##_v a1, a2;							\
+  };									\
+									\
+  struct name##_state {							\
+    name##_v s1, s2;							\
+  };									\
+									\
+  static inline void name##_set(struct name##_coeffs *c, int lane, struct biquad_norm k) { \
+    c->b0[lane] = k.b0; c->b1[lane] = k.b1; c->b2[lane] = k.b2;	\
+    c->a1[lane] = k.a1; c->a2[lane] = k.a2;				\
+  }									\
+									\
+  static inline void name##_tick(const struct name##_coeffs *c, struct name##_state *s, const name##_v *x, name##_v *y) { \
+    name##_v x0 = *x;							\
+    name##_v y0 = c->b0 * x0 + s->s1;					\
+    s->s1 = c->b1 * x0 - c->a1 * y0 + s->s2;				\
+    s->s2 = c->b2 * x0 - c->a2 * y0;					\
+    *y = y0;								\
+  }									\
+									\
+  static inline void name##_ramp(struct name##_coeffs *delta, const struct name##_coeffs *from, \
+				 const struct name##_coeffs *to, int n) { \
+    type r = (type) 1 / n;						\
+    delta->b0 = (to->b0 - from->b0) * r;				\
+    delta->b1 = (to->b1 - from->b1) * r;				\
+    delta->b2 = (to->b2 - from->b2) * r;				\
+    delta->a1 = (to->a1 - from->a1) * r;				\
+    delta->a2 = (to->a2 - from->a2) * r;				\
+  }									\
+									\
+  static inline void name##_advance(struct name##_coeffs *c, const struct name##_coeffs *delta) { \
+    c->b0 += delta->b0; c->b1 += delta->b1; c->b2 += delta->b2;	\
+    c->a1 += delta->a1; c->a2 += delta->a2;				\
+  }									\
+									\
+  static inline void name##_process(const struct name##_coeffs *c, struct name##_state *s, \
+				    float *const *in, float *const *out, int n) { \
+    struct name##_coeffs k = *c;					\
+    struct name##_state t = *s;						\
+    name##_v buf[BIQUAD_CHUNK];						\
+    for (int pos = 0; pos < n; pos += BIQUAD_CHUNK) {			\
+      int len = n - pos < BIQUAD_CHUNK ? n - pos : BIQUAD_CHUNK;	\
+      FOR(l, lanes) FOR(i, len) buf[i][l] = in[l][pos + i];		\
+      FOR(i, len) name##_tick(&k, &t, &buf[i], &buf[i]);		\
+      FOR(l, lanes) FOR(i, len) out[l][pos + i] = buf[i][l];		\
+    }									\
+    *s = t;								\
+  }									\
+									\
+  static inline void name##_process_ramp(const struct name##_coeffs *from, const struct name##_coeffs *to, \
+					 struct name##_state *s,	\
+					 float *const *in, float *const *out, int n) { \
+    struct name##_coeffs k = *from, dk;					\
+    struct name##_state t = *s;						\
+    name##_v buf[BIQUAD_CHUNK];						\
+    name##_ramp(&dk, from, to, n);					\
+    for (int pos = 0; pos < n; pos += BIQUAD_CHUNK) {			\
+      int len = n - pos < BIQUAD_CHUNK ? n - pos : BIQUAD_CHUNK;	\
+      FOR(l, lanes) FOR(i, len) buf[i][l] = in[l][pos + i];		\
+      FOR(i, len) {							\
+	name##_tick(&k, &t, &buf[i], &buf[i]);				\
+	name##_advance(&k, &dk);					\
+      }									\
+      FOR(l, lanes) FOR(i, len) out[l][pos + i] = buf[i][l];		\
+    }									\
+    *s = t;								\
+  }
+
+BIQUAD_LANES(biquad2d, double, 2)
+BIQUAD_LANES(biquad4d, double, 4)
+BIQUAD_LANES(biquad8d, double, 8)
+BIQUAD_LANES(biquad2f, float, 2)
+BIQUAD_LANES(biquad4f, float, 4)
+BIQUAD_LANES(biquad8f, float, 8)
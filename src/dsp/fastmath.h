@@ -0,0 +1,223 @@
+// Approximations of the libm functions in the inner loops, in tiers of
+// accuracy.
+//
+// fast_tanh, fast_exp2, fast_exp, fast_log2, fast_pow, fast_sin, fast_cos
+// and fast_atan use the tier in FASTMATH_TIER, which the plugin defines
+// before including this header (and the dsp headers that use it):
+//
+//   #define FASTMATH_TIER FASTMATH_1E5
+//   #include "../dsp/fastmath.h"
+//
+//   FASTMATH_EXACT  libm, the default
+//   FASTMATH_1E5    error below 1e-5
+//   FASTMATH_1E3    error below 1e-3
+//
+// The error is absolute for tanh, log2, sin, cos and atan, and relative for
+// exp2, exp and pow. fast_sinf takes and returns float and is sinf itself
+// with FASTMATH_EXACT, for loops written against sinf that should stay
+// bit-identical there. `make FASTMATH=FASTMATH_EXACT` (or another tier)
+// overrides the tier of every plugin, to compare by ear or with the bench
+// targets. fastmath-report (src/fastmath-report.c) prints the measured error
+// and speed of each function and tier.
+//
+// The approximations have no branches or table lookups, so loops calling
+// them vectorize. Domains: exp2 saturates outside [-1022, 1023], log2 wants
+// x > 0, pow returns 0 for x <= 0 and sin and cos want |x| < 1e9.
+
+#include <math.h>
+#include <stdint.h>
+
+#define FASTMATH_EXACT 0
+#define FASTMATH_1E5 5
+#define FASTMATH_1E3 3
+
+#ifdef FASTMATH_OVERRIDE
+#undef FASTMATH_TIER
+#define FASTMATH_TIER FASTMATH_OVERRIDE
+#endif
+
+#ifndef FASTMATH_TIER
+#define FASTMATH_TIER FASTMATH_EXACT
+#endif
+
+static inline double fastmath_from_bits(int64_t bits) {
+  union { int64_t i; double d; } u = { .i = bits };
+  return u.d;
+}
+
+static inline int64_t fastmath_to_bits(double x) {
+  union { double d; int64_t i; } u = { .d = x };
+  return u.i;
+}
+
+// Nearest integer, for |x| < 2^31
+static inline int fastmath_round(double x) {
+  return (int) (x + (x < 0 ? -0.5 : 0.5));
+}
+
+// 2^n for -1022 <= n <= 1023
+static inline double fastmath_exp2i(int n) {
+  return fastmath_from_bits((int64_t) (n + 1023) << 52);
+}
+
+// exp2: 2^x = 2^n * 2^f with n = round(x) and |f| <= 0.5, minimax
+// polynomial for 2^f.
+
+static inline double fast_exp2_1e3(double x) {
+  x = fmin(fmax(x, -1022), 1023);
+  int n = fastmath_round(x);
+  double f = x - n;
+  double p = 0.999928073608474 + f * (0.6932609868129616 + f * (0.2426111216321594 + f * 0.05517166173161512));
+  return p * fastmath_exp2i(n);
+}
+
+static inline double fast_exp2_1e5(double x) {
+  x = fmin(fmax(x, -1022), 1023);
+  int n = fastmath_round(x);
+  double f = x - n;
+  double p = 0.9999992614394169 + f * (0.6931218147490148 + f * (0.24024744848745685 + f * (0.05591786025330914 + f * 0.009570101065871745)));
+  return p * fastmath_exp2i(n);
+}
+
+static inline double fast_exp_1e3(double x) {
+  return fast_exp2_1e3(x * M_LOG2E);
+}
+
+static inline double fast_exp_1e5(double x) {
+  return fast_exp2_1e5(x * M_LOG2E);
+}
+
+// log2: x = 2^e * m with m in [sqrt(1/2), sqrt(2)), and
+// log2(m) = 2 / ln(2) * atanh(s) with s = (m - 1) / (m + 1), |s| < 0.172.
+// The exponent field is turned into a double by placing it in the mantissa
+// of 2^52, which vectorizes where an int64 conversion does not.
+
+static inline double fastmath_log2_reduce(double x, double *e) {
+  int64_t bits = fastmath_to_bits(x);
+  double m = fastmath_from_bits((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+  *e = fastmath_from_bits(((bits >> 52) & 0x7ff) | 0x4330000000000000LL) - (4503599627370496.0 + 1023);
+  if (m > M_SQRT2) {
+    m *= 0.5;
+    *e += 1;
+  }
+  return (m - 1) / (m + 1);
+}
+
+static inline double fast_log2_1e3(double x) {
+  double e, s = fastmath_log2_reduce(x, &e);
+  return e + s * (2.885228570353437 + s * s * 0.9835344779483026);
+}
+
+static inline double fast_log2_1e5(double x) {
+  double e, s = fastmath_log2_reduce(x, &e);
+  double s2 = s * s;
+  return e + s * (2.8853912893591986 + s2 * (0.9614708100888698 + s2 * 0.5989738570653242));
+}
+
+// pow: exp2(y * log2(x)). The absolute error of log2 adds a relative error
+// of about |y| times the one of log2.
+
+static inline double fast_pow_1e3(double x, double y) {
+  return x > 0 ? fast_exp2_1e3(y * fast_log2_1e3(x)) : 0;
+}
+
+static inline double fast_pow_1e5(double x, double y) {
+  return x > 0 ? fast_exp2_1e5(y * fast_log2_1e5(x)) : 0;
+}
+
+// tanh: x * P(x^2) / Q(x^2), exact slope at 0 so that tanh(x) / x stays
+// accurate for small x, clamped where the rational function peaks.
+
+static inline double fast_tanh_1e3(double x) {
+  x = fmin(fmax(x, -4.051035), 4.051035);
+  double x2 = x * x;
+  return x * (1 + x2 * 0.08044969001733755) / (1 + x2 * (0.4114114841307318 + x2 * 0.006121931924931734));
+}
+
+static inline double fast_tanh_1e5(double x) {
+  x = fmin(fmax(x, -7.0), 7.0);
+  double x2 = x * x;
+  return x * (1 + x2 * (0.12321713469460163 + x2 * (0.002292681603681001 + x2 * 3.993767584482947e-06)))
+    / (1 + x2 * (0.45654375799091595 + x2 * (0.021149913202669016 + x2 * 0.00014393737856350613)));
+}
+
+// sin: reduced to [-pi, pi] by whole turns and then to [-pi/2, pi/2] by
+// sin(x) = sin(+-pi - x), minimax odd polynomial.
+
+static inline double fastmath_sin_reduce(double x) {
+  x -= 2 * M_PI * fastmath_round(x * (0.5 / M_PI));
+  x = x > M_PI_2 ? M_PI - x : x;
+  x = x < -M_PI_2 ? -M_PI - x : x;
+  return x;
+}
+
+static inline double fast_sin_1e3(double x) {
+  x = fastmath_sin_reduce(x);
+  double x2 = x * x;
+  return x * (0.999696775234995 + x2 * (-0.16567308219735918 + x2 * 0.007514378037102132));
+}
+
+static inline double fast_sin_1e5(double x) {
+  x = fastmath_sin_reduce(x);
+  double x2 = x * x;
+  return x * (0.9999966159407843 + x2 * (-0.1666482839056448 + x2 * (0.008306325290269196 + x2 * -0.0001836365534337559)));
+}
+
+static inline double fast_cos_1e3(double x) {
+  return fast_sin_1e3(x + M_PI_2);
+}
+
+static inline double fast_cos_1e5(double x) {
+  return fast_sin_1e5(x + M_PI_2);
+}
+
+// atan: on t = min(|x|, 1) / max(|x|, 1) in [0, 1], with
+// atan(x) = pi/2 - atan(1/x) for |x| > 1, minimax odd polynomial.
+
+static inline double fast_atan_1e3(double x) {
+  double a = fabs(x);
+  double t = fmin(a, 1) / fmax(a, 1);
+  double t2 = t * t;
+  double r = t * (0.9953579554992926 + t2 * (-0.28869022431115776 + t2 * 0.07933902441029249));
+  r = a > 1 ? M_PI_2 - r : r;
+  return copysign(r, x);
+}
+
+static inline double fast_atan_1e5(double x) {
+  double a = fabs(x);
+  double t = fmin(a, 1) / fmax(a, 1);
+  double t2 = t * t;
+  double r = t * (0.9999772192064021 + t2 * (-0.33262282925589864 + t2 * (0.19354038062833612 + t2 * (-0.11642648799356893
+    + t2 * (0.052647354495674634 + t2 * -0.011719136038231416)))));
+  r = a > 1 ? M_PI_2 - r : r;
+  return copysign(r, x);
+}
+
+// Selected tier
+
+#if FASTMATH_TIER == FASTMATH_EXACT
+#define FASTMATH_FN(name) name
+#elif FASTMATH_TIER == FASTMATH_1E5
+#define FASTMATH_FN(name) fast_##name##_1e5
+#elif FASTMATH_TIER == FASTMATH_1E3
+#define FASTMATH_FN(name) fast_##name##_1e3
+#else
+#error "FASTMATH_TIER must be FASTMATH_EXACT, FASTMATH_1E5 or FASTMATH_1E3"
+#endif
+
+static inline double fast_tanh(double x) { return FASTMATH_FN(tanh)(x); }
+static inline double fast_exp2(double x) { return FASTMATH_FN(exp2)(x); }
+static inline double fast_exp(double x) { return FASTMATH_FN(exp)(x); }
+static inline double fast_log2(double x) { return FASTMATH_FN(log2)(x); }
+static inline double fast_pow(double x, double y) { return FASTMATH_FN(pow)(x, y); }
+static inline double fast_sin(double x) { return FASTMATH_FN(sin)(x); }
+static inline double fast_cos(double x) { return FASTMATH_FN(cos)(x); }
+static inline double fast_atan(double x) { return FASTMATH_FN(atan)(x); }
+
+#if FASTMATH_TIER == FASTMATH_EXACT
+static inline float fast_sinf(float x) { return sinf(x); }
+#else
+static inline float fast_sinf(float x) { return FASTMATH_FN(sin)(x); }
+#endif
+
+#undef FASTMATH_FN
@@ -3,6 +3,11 @@
 //   jw-jw^3 = 0 -> 3w-w^3 = 0 -> 3-w^2 = 0 -> w^2 = 3 -> w=sqrt(3)
 // at this freq, attenuation is
 //   1 - 3w^2 = 1-9 = -8.
+//
+// The saturation is fast_tanh, so fastmath.h goes before this header.
+//
+// The _k variants take the coefficient ladder_coeff(f * dt), e.g. from a
+// prewarp.h table, in place of dt and f.
 
 struct ladder {
   double old_input, old_output;
@@ -10,11 +15,15 @@ struct ladder {
 };
 
 static inline double ladder_shape(double x) {
-  return tanh(x);
+  return fast_tanh(x);
 }
 
-static inline double ladder_tick(struct ladder *ladder, double dt, double f, double fb, double clip_level, double input) {
-  double k = fmin(1., dt * 2 * 3.141592 * f);
+// x is the cutoff over the sample rate
+static inline double ladder_coeff(double x) {
+  return fmin(1., x * 2 * 3.141592);
+}
+
+static inline double ladder_tick_k(struct ladder *ladder, double k, double fb, double clip_level, double input) {
   double lp = 0.5 * (input + ladder->old_input) - ladder_shape(ladder->z2 * fb / clip_level) * clip_level;
   ladder->old_input = input;
   lp = ladder->z0 += ladder_shape(lp - ladder->z0) * k;
@@ -26,13 +35,15 @@ static inline double ladder_tick(struct ladder *ladder, double dt, double f, dou
   return ladder->old_output;
 }
 
-static inline double ladder_shape_gain(double x) {
-  return fabs(x) < 1e-20 ? 1 : tanh(x) / x;
+static inline double ladder_tick(struct ladder *ladder, double dt, double f, double fb, double clip_level, double input) {
+  return ladder_tick_k(ladder, ladder_coeff(dt * f), fb, clip_level, input);
 }
 
-static inline double ladder_tick_nonlinear_blt(struct ladder *ladder, double dt, double f, double fb, double clip_level, double input) {
-  double k = fmin(1., dt * 2 * 3.141592 * f);
+static inline double ladder_shape_gain(double x) {
+  return fabs(x) < 1e-20 ? 1 : fast_tanh(x) / x;
+}
 
+static inline double ladder_tick_nonlinear_blt_k(struct ladder *ladder, double k, double fb, double clip_level, double input) {
   fb = fb * ladder_shape_gain(ladder->z2 * fb / clip_level) * clip_level;
 
   double k0 = k * ladder_shape_gain(ladder->old_input - ladder->z0 - fb * ladder->z2);
@@ -67,3 +78,7 @@ static inline double ladder_tick_nonlinear_blt(struct ladder *ladder, double dt,
 
   return ladder->z2;
 }
+
+static inline double ladder_tick_nonlinear_blt(struct ladder *ladder, double dt, double f, double fb, double clip_level, double input) {
+  return ladder_tick_nonlinear_blt_k(ladder, ladder_coeff(dt * f), fb, clip_level, input);
+}
@@ -0,0 +1,52 @@
+// Table of a filter's cutoff coefficient against pitch, for filters whose
+// cutoff moves every frame.
+//
+// prewarp_init tabulates coeff(freq * dt) for the given sample rate, where
+// coeff is the filter's own mapping from normalized frequency (cycles per
+// frame) to its coefficient: svf_coeff, ap_coeff, ladder_coeff. Lookups
+// interpolate linearly between PREWARP_STEPS points per semitone, which keeps
+// the cutoff of the svf within 0.03 cents up to a quarter of the sample rate
+// and within 0.2 cents up to 0.45 of it. Pitches outside the table, which
+// runs from PREWARP_MIN_PITCH (1 Hz) to far above Nyquist, are clamped.
+//
+//   static struct prewarp svf_table;
+//   prewarp_init(&svf_table, sample_rate, svf_coeff);
+//   ...
+//   double f = prewarp_pitch(&svf_table, cutoff_pitch + 12 * env);
+//   double f = prewarp_norm(&svf_table, cutoff_hz * dt);
+//
+// prewarp_norm uses fastmath.h, which goes before this header.
+
+#define PREWARP_MIN_PITCH -36
+#define PREWARP_STEPS 8
+#define PREWARP_SIZE 2048
+
+struct prewarp {
+  double norm_offset; // table index of normalized frequency 1
+  float table[PREWARP_SIZE];
+};
+
+static inline void prewarp_init(struct prewarp *t, double sample_rate, double (*coeff)(double x)) {
+  FOR(i, PREWARP_SIZE) {
+    double pitch = PREWARP_MIN_PITCH + i * (1.0 / PREWARP_STEPS);
+    t->table[i] = coeff(440 * pow(2, (pitch - 69) / 12) / sample_rate);
+  }
+  t->norm_offset = (69 + 12 * log2(sample_rate / 440) - PREWARP_MIN_PITCH) * PREWARP_STEPS;
+}
+
+static inline double prewarp_lookup(const struct prewarp *t, double index) {
+  index = fmin(fmax(index, 0), PREWARP_SIZE - 1.001);
+  int i = (int) index;
+  double frac = index - i;
+  return t->table[i] + (t->table[i + 1] - t->table[i]) * frac;
+}
+
+// Fractional MIDI pitch, 69 = 440 Hz
+static inline double prewarp_pitch(const struct prewarp *t, double pitch) {
+  return prewarp_lookup(t, (pitch - PREWARP_MIN_PITCH) * PREWARP_STEPS);
+}
+
+// Normalized frequency, freq * dt
+static inline double prewarp_norm(const struct prewarp *t, double x) {
+  return prewarp_lookup(t, t->norm_offset + (12 * PREWARP_STEPS) * fast_log2_1e5(x));
+}
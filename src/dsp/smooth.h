@@ -0,0 +1,117 @@
+// Parameter smoothing: a CC change glides to its new value instead of
+// stepping at the next block boundary, so the block size no longer decides
+// how much zipper noise a knob makes.
+//
+// A struct smooth follows up to SMOOTH_MAX CCs of a plugin in their own
+// 0..127 scale. Smoothing before the plugin's pow()/exp() mapping makes
+// frequency knobs glide in octaves and gain knobs in decibels. All
+// parameters move together and every loop runs across all SMOOTH_MAX lanes,
+// so they vectorize.
+//
+// The plugin_cc_changed hook calls smooth_set_cc to retarget. plugin_process
+// then reads the values with either
+//   - smooth_tick, once per frame, for a smoothed value per frame, or
+//   - smooth_block, once per block, which leaves the values at the start of
+//     the block in start[] and at its end in value[]. The plugin interpolates
+//     between them, or computes its coefficients at both ends and
+//     interpolates those. It returns 0 when nothing moves, so the plugin can
+//     keep its plain loop for the common case.
+//
+// SMOOTH_ONE_POLE approaches the target exponentially with time constant
+// `seconds` and snaps to it after about 7 time constants (-60 dB).
+// SMOOTH_LINEAR ramps to the target in `seconds`; a new target mid-ramp
+// starts a new ramp from where it is.
+//
+//   smooth_init(&h->smooth, SMOOTH_LINEAR, 0.02, sample_rate);
+//   smooth_add_cc(&h->smooth, CC_GAIN); // lane 0
+//   ...
+//   cc_changed(instance);
+//   smooth_snap(&h->smooth);
+
+#define SMOOTH_MAX 16
+
+enum smooth_mode {
+  SMOOTH_ONE_POLE,
+  SMOOTH_LINEAR,
+};
+
+struct smooth {
+  enum smooth_mode mode;
+  int num;
+  int ramp_len;  // frames until a new target is reached
+  int remaining; // frames left of the current ramp, 0 when settled
+  float coeff;   // SMOOTH_ONE_POLE: per-frame approach
+  float rate;    // SMOOTH_ONE_POLE: 1 / time constant in frames
+  unsigned char cc[SMOOTH_MAX];
+  float value[SMOOTH_MAX];
+  float target[SMOOTH_MAX];
+  float step[SMOOTH_MAX]; // SMOOTH_LINEAR: per frame
+  float start[SMOOTH_MAX]; // set by smooth_block
+};
+
+static inline void smooth_init(struct smooth *s, enum smooth_mode mode, double seconds, double sample_rate) {
+  memset(s, 0, sizeof(*s));
+  s->mode = mode;
+  double frames = fmax(1.0, seconds * sample_rate);
+  s->rate = 1.0 / frames;
+  s->coeff = -expm1(-s->rate);
+  s->ramp_len = mode == SMOOTH_LINEAR ? frames : ceil(frames * log(1000.0));
+}
+
+// Returns the lane of the CC.
+static inline int smooth_add_cc(struct smooth *s, int cc_number) {
+  CHECK(s->num < SMOOTH_MAX, "too many smoothed CCs");
+  s->cc[s->num] = cc_number;
+  return s->num++;
+}
+
+static inline void smooth_snap(struct smooth *s) {
+  for (int i = 0; i < SMOOTH_MAX; i++) {
+    s->value[i] = s->target[i];
+    s->start[i] = s->target[i];
+  }
+  s->remaining = 0;
+}
+
+static inline void smooth_set_cc(struct smooth *s, const char *wrapper_cc) {
+  for (int i = 0; i < s->num; i++) {
+    s->target[i] = wrapper_cc[s->cc[i]];
+  }
+  s->remaining = s->ramp_len;
+  if (s->mode == SMOOTH_LINEAR) {
+    float r = 1.0f / s->ramp_len;
+    for (int i = 0; i < SMOOTH_MAX; i++) {
+      s->step[i] = (s->target[i] - s->value[i]) * r;
+    }
+  }
+}
+
+static inline const float *smooth_tick(struct smooth *s) {
+  if (s->remaining == 0) return s->value;
+  if (--s->remaining == 0) {
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] = s->target[i];
+  } else if (s->mode == SMOOTH_LINEAR) {
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] += s->step[i];
+  } else {
+    float k = s->coeff;
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] += (s->target[i] - s->value[i]) * k;
+  }
+  return s->value;
+}
+
+static inline int smooth_block(struct smooth *s, int nframes) {
+  for (int i = 0; i < SMOOTH_MAX; i++) s->start[i] = s->value[i];
+  if (s->remaining == 0) return 0;
+  if (nframes >= s->remaining) {
+    s->remaining = 0;
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] = s->target[i];
+  } else if (s->mode == SMOOTH_LINEAR) {
+    s->remaining -= nframes;
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] += s->step[i] * nframes;
+  } else {
+    s->remaining -= nframes;
+    float k = -expm1f(-s->rate * nframes);
+    for (int i = 0; i < SMOOTH_MAX; i++) s->value[i] += (s->target[i] - s->value[i]) * k;
+  }
+  return 1;
+}
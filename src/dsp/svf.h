@@ -1,14 +1,53 @@
+// State variable filter, linear and with tanh saturation.
+//
+// svf_tick and svf_tick_nonlinear take the cutoff in Hz and call tan() on
+// every frame. Where the cutoff is modulated per frame, take it through a
+// struct svf_control instead: it prewarps once every SVF_CONTROL_TICK
+// frames and interpolates f linearly in between, one tick behind, and the
+// _f variants run the filter on the result. A zeroed svf_control starts
+// from f = 0 and reaches the cutoff after its first tick. Where the cutoff
+// is a pitch, a prewarp.h table of svf_coeff gives f without a tan() at all.
+//
+//   double f = svf_control_tick(&h->control, dt, cutoff * (1 + env));
+//   out[i] = svf_tick_nonlinear_f(&h->svf, f, q, 1, in[i]);
+//
+// The saturation is fast_tanh, so fastmath.h goes before this header.
+
+#define SVF_CONTROL_TICK 16
+
 struct svf {
   double last_input;
   double z1, z2;
 };
 
-static inline double svf_tick(struct svf* state, double dt, double freq, double q, double input) {
-  freq *= dt;
-  if (freq > 0.499) {
-    freq = 0.499;
+// x is the cutoff over the sample rate
+static inline double svf_coeff(double x) {
+  if (x > 0.499) {
+    x = 0.499;
+  }
+  double omega = 2 * M_PI * x;
+  return tan(0.5 * omega);
+}
+
+static inline double svf_prewarp(double dt, double freq) {
+  return svf_coeff(freq * dt);
+}
+
+struct svf_control {
+  double f, df;
+  int left; // frames until the next prewarp
+};
+
+static inline double svf_control_tick(struct svf_control *c, double dt, double freq) {
+  if (c->left == 0) {
+    c->df = (svf_prewarp(dt, freq) - c->f) * (1.0 / SVF_CONTROL_TICK);
+    c->left = SVF_CONTROL_TICK;
   }
-  double omega = 2 * M_PI * freq;
+  c->left--;
+  return c->f += c->df;
+}
+
+static inline double svf_tick_f(struct svf* state, double f, double q, double input) {
   /*                                                                          
     // compute output                                                          
 
@@ -29,7 +68,6 @@ static inline double svf_tick(struct svf* state, double dt, double freq, double
     (1 + q * f + f * f) hp = in - (q + f) * z1 - z2;
   */
 
-  double f = tan(0.5 * omega);
   double r = f + q;
   double g = 1 / (f * r + 1);
 
@@ -45,16 +83,16 @@ static inline double svf_tick(struct svf* state, double dt, double freq, double
   return lp;
 }
 
+static inline double svf_tick(struct svf* state, double dt, double freq, double q, double input) {
+  return svf_tick_f(state, svf_prewarp(dt, freq), q, input);
+}
+
 static inline double svf_shape(double x) {
-  return fabs(x) < 1e-12 ? 1.0 : tanh(x) / x;
+  return fabs(x) < 1e-12 ? 1.0 : fast_tanh(x) / x;
 }
 
-static inline double svf_tick_nonlinear(struct svf *state, double dt, double freq, double q, double input) {
-  freq *= dt;
-  if (freq > 0.499) {
-    freq = 0.499;
-  }
-  double omega = 2 * M_PI * freq;
+// grit scales the signal going into the saturation.
+static inline double svf_tick_nonlinear_f(struct svf *state, double f, double q, double grit, double input) {
   /*                                                                          
     // compute output                                                          
 
@@ -75,12 +113,11 @@ static inline double svf_tick_nonlinear(struct svf *state, double dt, double fre
     (1 + q * k1 + k1 * k2) hp = in - (q + k2) * z1 - z2;
   */
 
-  double f = tan(0.5 * omega);
-
+  grit *= grit;
   double half_delayed_input = (input + state->last_input) * 0.5;
   double fb = half_delayed_input - q * state->z1 - state->z2;
-  double k1 = f * svf_shape(fb);
-  double k2 = f * svf_shape(state->z2);
+  double k1 = f * svf_shape(fb * grit);
+  double k2 = f * svf_shape(state->z2 * grit);
 
   double r = q + k2;
   double g = 1 / (k1 * r + 1);
@@ -97,3 +134,7 @@ static inline double svf_tick_nonlinear(struct svf *state, double dt, double fre
 
   return lp;
 }
+
+static inline double svf_tick_nonlinear(struct svf *state, double dt, double freq, double q, double input) {
+  return svf_tick_nonlinear_f(state, svf_prewarp(dt, freq), q, 1, input);
+}
@@ -0,0 +1,90 @@
+// Error report and benchmark for src/dsp/fastmath.h.
+//
+// For every function and tier, prints the largest error against libm over a
+// dense grid of its range (absolute or relative, as documented in
+// fastmath.h) and the time per call in a loop over an array, which is how
+// the plugins call them.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "dsp/fastmath.h"
+
+#define N 4096
+#define ERROR_POINTS 10000000
+#define BENCH_NS 100000000
+
+static double pow_3_7(double x) { return pow(x, 3.7); }
+static double fast_pow_3_7_1e3(double x) { return fast_pow_1e3(x, 3.7); }
+static double fast_pow_3_7_1e5(double x) { return fast_pow_1e5(x, 3.7); }
+
+// name, exact, 1e-5 tier, 1e-3 tier, range, relative error
+#define FUNCTIONS \
+  X(tanh, tanh, fast_tanh_1e5, fast_tanh_1e3, -10, 10, 0) \
+  X(exp2, exp2, fast_exp2_1e5, fast_exp2_1e3, -30, 30, 1) \
+  X(exp, exp, fast_exp_1e5, fast_exp_1e3, -20, 20, 1) \
+  X(log2, log2, fast_log2_1e5, fast_log2_1e3, 1e-3, 1e3, 0) \
+  X(pow(x, 3.7), pow_3_7, fast_pow_3_7_1e5, fast_pow_3_7_1e3, 1e-3, 10, 1) \
+  X(sin, sin, fast_sin_1e5, fast_sin_1e3, -100, 100, 0) \
+  X(cos, cos, fast_cos_1e5, fast_cos_1e3, -100, 100, 0) \
+  X(atan, atan, fast_atan_1e5, fast_atan_1e3, -100, 100, 0)
+
+// One array loop per function and tier, for the compiler to vectorize
+#define LOOP(f) \
+  static void loop_##f(const double *restrict in, double *restrict out) { \
+    for (int i = 0; i < N; i++) out[i] = f(in[i]); \
+  }
+#define X(name, exact, t5, t3, lo, hi, rel) LOOP(exact) LOOP(t5) LOOP(t3)
+FUNCTIONS
+#undef X
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double max_error(double (*exact)(double), double (*approx)(double), double lo, double hi, int rel) {
+  double max = 0;
+  for (int i = 0; i <= ERROR_POINTS; i++) {
+    double x = lo + (hi - lo) * i / ERROR_POINTS;
+    double y = exact(x);
+    double error = fabs(approx(x) - y);
+    if (rel) error /= fabs(y);
+    max = fmax(max, error);
+  }
+  return max;
+}
+
+static double ns_per_call(void (*loop)(const double*, double*), double lo, double hi) {
+  static double in[N], out[N];
+  for (int i = 0; i < N; i++) in[i] = lo + (hi - lo) * rand() / RAND_MAX;
+  loop(in, out);
+  long calls = 0;
+  double start = now(), elapsed;
+  do {
+    loop(in, out);
+    calls += N;
+  } while ((elapsed = now() - start) < BENCH_NS);
+  return elapsed / calls;
+}
+
+static void report(const char *name, const char *tier, double (*exact)(double), double (*approx)(double),
+    void (*loop)(const double*, double*), double lo, double hi, int rel) {
+  printf("%-12s %-6s [%g, %g]  ", name, tier, lo, hi);
+  if (approx) printf("%s error %-9.2g", rel ? "rel" : "abs", max_error(exact, approx, lo, hi, rel));
+  else printf("%-19s", "");
+  printf("  %6.2f ns\n", ns_per_call(loop, lo, hi));
+}
+
+int main(int argc, char **argv) {
+#define X(name, exact, t5, t3, lo, hi, rel) \
+  report(#name, "libm", exact, NULL, loop_##exact, lo, hi, rel); \
+  report(#name, "1e-5", exact, t5, loop_##t5, lo, hi, rel); \
+  report(#name, "1e-3", exact, t3, loop_##t3, lo, hi, rel);
+  FUNCTIONS
+#undef X
+  return 0;
+}
@@ -14,8 +14,10 @@
 
 #define SYNTH_URI "urn:magnusjonsson:mjack:lv2:click"
 
+#include "../util/log.h"
 #include "../util/lv2utils.h"
 #include "../util/uris.h"
+#include "../../wrappers/rtcheck.h"
 
 #define PARAMS					\
 
@@ -65,6 +67,7 @@ struct synth {
   LV2_Atom_Forge forge;
   LV2_Atom_Forge_Frame notify_frame;
   struct uris uris;
+  struct log log;
 
   const LV2_Atom_Sequence *control;
   const LV2_Atom_Sequence *notify;
@@ -79,40 +82,42 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
 			      double sample_rate,
 			      const char *bundle_path,
 			      const LV2_Feature *const *host_features) {
-  fprintf(stderr, "Instantiating\n");
+  LOG(LOG_DEBUG, "Instantiating\n");
   struct synth *self;
   {
     self = calloc(1, sizeof(struct synth));
     self->dt = 1.0 / sample_rate;
   }
 
-  fprintf(stderr, "Getting mappers\n");
+  LOG(LOG_DEBUG, "Getting mappers\n");
   {
     self->map = get_host_feature(host_features, LV2_URID__map);
-    if (!self->map) { fprintf(stderr, "Could not get URID map host feature\n"); goto err; }
+    if (!self->map) { LOG(LOG_ERROR, "Could not get URID map host feature\n"); goto err; }
     self->unmap = get_host_feature(host_features, LV2_URID__unmap);
-    if (!self->unmap) { fprintf(stderr, "Could not get URID unmap host feature\n"); goto err; }
+    if (!self->unmap) { LOG(LOG_ERROR, "Could not get URID unmap host feature\n"); goto err; }
   }
 
-  fprintf(stderr, "Mapping uris\n");
+  LOG(LOG_DEBUG, "Mapping uris\n");
   {
     uris_init(&self->uris, self->map);
   }
 
-  fprintf(stderr, "Initializing forge\n");
+  LOG(LOG_DEBUG, "Initializing forge\n");
   {
     lv2_atom_forge_init(&self->forge, self->map);
   }
 
-  fprintf(stderr, "Initializing voices\n");
+  LOG(LOG_DEBUG, "Initializing voices\n");
   {
     voice_init(&self->voice);
   }
 
-  fprintf(stderr, "Done\n");
+  log_start(&self->log, "click");
+
+  LOG(LOG_DEBUG, "Done\n");
   return self;
  err:
-  fprintf(stderr, "Could not initialize\n");
+  LOG(LOG_ERROR, "Could not initialize\n");
   free(self);
   return NULL;
 }
@@ -130,7 +135,7 @@ static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
 }
 
 static void activate(LV2_Handle instance) {
-  fprintf(stderr, "activate()\n");
+  LOG(LOG_DEBUG, "activate()\n");
 }
 
 static void handle_note_on(struct synth *self, int note, int velocity) {
@@ -164,6 +169,7 @@ static void run_audio(struct synth *self, uint32_t offset, uint32_t end) {
 
 static void run(LV2_Handle handle, uint32_t nframes) {
   struct synth *self = handle;
+  RTCHECK_ENTER("LV2 run");
 
   const uint32_t notify_capacity = self->notify->atom.size;
   lv2_atom_forge_set_buffer(&self->forge,
@@ -179,25 +185,28 @@ static void run(LV2_Handle handle, uint32_t nframes) {
       handle_midi(self, msg);
     }
     else {
-      fprintf(stderr, "Unknown event type: %s", self->unmap->unmap(self->unmap->handle, ev->body.type));
+      LOG_RT(&self->log, LOG_WARNING, "Unknown event type %u\n", ev->body.type);
     }
     offset = ev->time.frames;
   }
   run_audio(self, offset, nframes);
+  RTCHECK_LEAVE();
 }
 
 static void deactivate(LV2_Handle instance) {
-  fprintf(stderr, "deactivate\n");
+  LOG(LOG_DEBUG, "deactivate\n");
 }
 
 static void cleanup(LV2_Handle instance) {
-  fprintf(stderr, "cleanup\n");
-  free(instance);
+  LOG(LOG_DEBUG, "cleanup\n");
+  struct synth *self = instance;
+  log_stop(&self->log);
+  free(self);
 }
 
 static const void *extension_data(const char *uri) {
-  fprintf(stderr, "extension_data\n");
-  fprintf(stderr, "Unknown extension data requested: %s\n", uri);
+  LOG(LOG_DEBUG, "extension_data\n");
+  LOG(LOG_INFO, "Unknown extension data requested: %s\n", uri);
   return NULL;
 }
 
@@ -10,13 +10,19 @@
 #include "lv2/lv2plug.in/ns/ext/patch/patch.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
 #include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #define SYNTH_URI "urn:magnusjonsson:mjack:lv2:harmonic_synth"
 
+#include "../util/log.h"
 #include "../util/lv2utils.h"
 #include "../util/uris.h"
+#include "../../wrappers/rtcheck.h"
 #include "../../tuning/scala.h"
+#include "../util/tuning.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../../dsp/fastmath.h"
 
 #define FOR(i, n) for(int i = 0; i < n; i++)
 
@@ -190,9 +196,9 @@ static void voice_tick(struct voice *v, struct params const *p, double dt, float
   FOR(i, NUM_OSC) {
     rate[i] = freq * fmax(1e-6, tune[i] * (1 + fine[i]));
   }
-  double w = dt * 100000 * cube(*p->lpf) * pow(freq/220, *p->lpf_trk) * pow(2*body_env, *p->lpf_env);
+  double w = dt * 100000 * cube(*p->lpf) * fast_pow(freq/220, *p->lpf_trk) * fast_pow(2*body_env, *p->lpf_env);
 
-  double g_overall = pow(2*body_env, *p->amp_env);
+  double g_overall = fast_pow(2*body_env, *p->amp_env);
   
   double sum = 0;
 
@@ -209,25 +215,27 @@ static void voice_tick(struct voice *v, struct params const *p, double dt, float
     switch ((int) *p->waveform) {
     case 0: // saw
       {
-	double c = cos(phase*2*3.141592) * exp(-16*travel/w);
-	double s = sin(phase*2*3.141592) * exp(-16*travel/w);
-	sum += atan(s/(1+c)) * g;
+	double c = fast_cos(phase*2*3.141592) * fast_exp(-16*travel/w);
+	double s = fast_sin(phase*2*3.141592) * fast_exp(-16*travel/w);
+	sum += fast_atan(s/(1+c)) * g;
       }
       break;
     case 1: // square 1
       {
-	double s = sin(phase*2*3.141592) * 0.1 * w / travel;
+	double s = fast_sin(phase*2*3.141592) * 0.1 * w / travel;
 	sum += s / sqrt(1 + s * s) * g;
       }
       break;
     case 2: // square 2
       {
-	double s = sin(phase*2*3.141592);
-	sum += atan(s * 0.1 * w / travel) * g;
+	double s = fast_sin(phase*2*3.141592);
+	sum += fast_atan(s * 0.1 * w / travel) * g;
       }
       break;
     case 3: // "square" impulse train with filter
       {
+	// libm here and below: 1 - A cancels for cutoffs far below the
+	// harmonic, which would blow up the error of fastmath.h
 	double k_abs = -2*3.141592 * fmax(1e-6, w/travel);
 	double k_cos = cos(0.5*3.141592 * fmax(0.005, fmin(0.99, *p->res)));
 	double k_sin = sin(0.5*3.141592 * fmax(0.005, fmin(0.99, *p->res)));
@@ -273,14 +281,13 @@ static void voice_tick(struct voice *v, struct params const *p, double dt, float
   *out_right = sum;
 }
 
-static void voice_handle_note_on(struct voice *v, float freq, int velo) {
-  fprintf(stderr, "note on! target_freq: %f  freq: %f\n", freq, v->freq);
+static void voice_handle_note_on(struct voice *v, struct log *log, float freq, int velo) {
+  LOG_RT(log, LOG_DEBUG, "note on! target_freq: %f  freq: %f\n", freq, v->freq);
   v->target_freq = freq;
   v->held = true;
   v->body_dcy = 1.0 / 128.0 * velo;
   FOR(i, NUM_LFO) {
-    fprintf(stderr, "lfosaw[%i]=%f\n", i, v->lfosaw[i]);
-    fprintf(stderr, "lfosqr[%i]=%f\n", i, v->lfosqr[i]);
+    LOG_RT(log, LOG_DEBUG, "lfosaw[%i]=%f lfosqr[%i]=%f\n", i, v->lfosaw[i], i, v->lfosqr[i]);
   }
 }
 
@@ -294,12 +301,12 @@ struct synth {
 
   LV2_URID_Map *map;
   LV2_URID_Unmap *unmap;
+  LV2_Worker_Schedule *schedule;
 
   LV2_Atom_Forge forge;
   LV2_Atom_Forge_Frame notify_frame;
   struct uris uris;
-
-  char scala_file[PATH_MAX];
+  struct log log;
 
   const LV2_Atom_Sequence *control;
   const LV2_Atom_Sequence *notify;
@@ -308,7 +315,7 @@ struct synth {
   struct params params;
 
   int current_note;
-  float freq[128];
+  struct tuning *tuning;
 
   struct voice voice;
 };
@@ -317,44 +324,48 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
 			      double sample_rate,
 			      const char *bundle_path,
 			      const LV2_Feature *const *host_features) {
-  fprintf(stderr, "Instantiating\n");
+  LOG(LOG_DEBUG, "Instantiating\n");
   struct synth *self;
   {
     self = calloc(1, sizeof(struct synth));
     self->dt = 1.0 / sample_rate;
   }
 
-  fprintf(stderr, "Getting mappers\n");
+  LOG(LOG_DEBUG, "Getting mappers\n");
   {
     self->map = get_host_feature(host_features, LV2_URID__map);
-    if (!self->map) { fprintf(stderr, "Could not get URID map host feature\n"); goto err; }
+    if (!self->map) { LOG(LOG_ERROR, "Could not get URID map host feature\n"); goto err; }
     self->unmap = get_host_feature(host_features, LV2_URID__unmap);
-    if (!self->unmap) { fprintf(stderr, "Could not get URID unmap host feature\n"); goto err; }
+    if (!self->unmap) { LOG(LOG_ERROR, "Could not get URID unmap host feature\n"); goto err; }
+    self->schedule = get_host_feature(host_features, LV2_WORKER__schedule);
+    if (!self->schedule) { LOG(LOG_ERROR, "Could not get worker schedule host feature\n"); goto err; }
   }
 
-  fprintf(stderr, "Mapping uris\n");
+  LOG(LOG_DEBUG, "Mapping uris\n");
   {
     uris_init(&self->uris, self->map);
   }
 
-  fprintf(stderr, "Initializing forge\n");
+  LOG(LOG_DEBUG, "Initializing forge\n");
   {
     lv2_atom_forge_init(&self->forge, self->map);
   }
 
-  fprintf(stderr, "Initializing frequency table\n");
+  LOG(LOG_DEBUG, "Initializing frequency table\n");
   {
-    for (int i = 0; i < 128; i++) {
-      self->freq[i] = 440.0 * pow(2.0, (i - 60.0) / 12.0);
-    }
+    self->tuning = tuning_new_equal(60);
+    if (!self->tuning) { goto err; }
   }
-  fprintf(stderr, "Initializing voice\n");
+  LOG(LOG_DEBUG, "Initializing voice\n");
   voice_init(&self->voice);
 
-  fprintf(stderr, "Done\n");
+  log_start(&self->log, "harmonic_synth");
+
+  LOG(LOG_DEBUG, "Done\n");
   return self;
  err:
-  fprintf(stderr, "Could not initialize\n");
+  LOG(LOG_ERROR, "Could not initialize\n");
+  free(self->tuning);
   free(self);
   return NULL;
 }
@@ -373,12 +384,12 @@ static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
 }
 
 static void activate(LV2_Handle instance) {
-  fprintf(stderr, "activate()\n");
+  LOG(LOG_DEBUG, "activate()\n");
 }
 
 static void handle_note_on(struct synth *self, int note, int velocity) {
   self->current_note = note;
-  voice_handle_note_on(&self->voice, self->freq[note], velocity);
+  voice_handle_note_on(&self->voice, &self->log, self->tuning->freq[note], velocity);
 }
 
 static void handle_note_off(struct synth *self, int note) {
@@ -408,42 +419,21 @@ static void run_audio(struct synth *self, uint32_t offset, uint32_t end) {
   }
 }
 
-static bool set_scala_file(struct synth *self, const char *filename) {
-  if (strlen(filename) < PATH_MAX) {
-    strncpy(self->scala_file, filename, PATH_MAX-1);
-    self->scala_file[PATH_MAX-1] = '\0';
-    // TODO do this in worker thread
-    float cents[128];
-    float freq[128];
-    if (!load_scala_file(filename, cents, freq)) {
-      fprintf(stderr, "Failed to load scala file %s\n", filename);
-      return false;
-    }
-    for (int i = 0; i < 128; i++) {
-      self->freq[i] = freq[i];
-    }
-    return true;
-  } else {
-    fprintf(stderr, "Scala file path too long!\n");
-    return false;
-  }
-}
-
 static void handle_patch_set(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch set\n");
-  const char *filename = read_set_scala_file(obj, &self->uris);
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch set\n");
+  const char *filename = read_set_scala_file(obj, &self->uris, &self->log);
   if (filename) {
-    fprintf(stderr, "scala file name: %s\n", filename);
-    set_scala_file(self, filename);
+    LOG_RT(&self->log, LOG_DEBUG, "scala file name: %s\n", filename);
+    tuning_schedule_load(self->schedule, filename, &self->log);
   } else {
-    fprintf(stderr, "Could not get scala filename from patch_set");
+    LOG_RT(&self->log, LOG_WARNING, "Could not get scala filename from patch_set\n");
   }
 }
 
 static void handle_patch_get(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch get\n");
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch get\n");
   lv2_atom_forge_frame_time(&self->forge, frames);
-  write_set_scala_file(&self->forge, &self->uris, self->scala_file);
+  write_set_scala_file(&self->forge, &self->uris, self->tuning->scala_file);
 }
 
 static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
@@ -454,12 +444,13 @@ static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, i
     handle_patch_get(self, obj, frames);
   }
   else {
-    fprintf(stderr, "Unknown atom object body type: %s", self->unmap->unmap(self->unmap->handle, obj->body.otype));
+    LOG_RT(&self->log, LOG_WARNING, "Unknown atom object body type %u\n", obj->body.otype);
   }
 }
 
 static void run(LV2_Handle handle, uint32_t nframes) {
   struct synth *self = handle;
+  RTCHECK_ENTER("LV2 run");
 
   const uint32_t notify_capacity = self->notify->atom.size;
   lv2_atom_forge_set_buffer(&self->forge,
@@ -479,20 +470,24 @@ static void run(LV2_Handle handle, uint32_t nframes) {
       handle_atom_object(self, obj, offset);
     }
     else {
-      fprintf(stderr, "Unknown event type: %s", self->unmap->unmap(self->unmap->handle, ev->body.type));
+      LOG_RT(&self->log, LOG_WARNING, "Unknown event type %u\n", ev->body.type);
     }
     offset = ev->time.frames;
   }
   run_audio(self, offset, nframes);
+  RTCHECK_LEAVE();
 }
 
 static void deactivate(LV2_Handle instance) {
-  fprintf(stderr, "deactivate\n");
+  LOG(LOG_DEBUG, "deactivate\n");
 }
 
 static void cleanup(LV2_Handle instance) {
-  fprintf(stderr, "cleanup\n");
-  free(instance);
+  LOG(LOG_DEBUG, "cleanup\n");
+  struct synth *self = instance;
+  log_stop(&self->log);
+  free(self->tuning);
+  free(self);
 }
 
 static LV2_State_Status save(LV2_Handle instance,
@@ -501,16 +496,16 @@ static LV2_State_Status save(LV2_Handle instance,
 			     uint32_t flags,
 			     const LV2_Feature *const *features)
 {
-  fprintf(stderr, "save\n");
+  LOG(LOG_DEBUG, "save\n");
   struct synth *self = instance;
   LV2_State_Map_Path *map_path = get_host_feature(features, LV2_STATE__mapPath);
   if (!map_path) {
-    fprintf(stderr, "no map path host feature\n");
+    LOG(LOG_ERROR, "no map path host feature\n");
     return LV2_STATE_ERR_NO_FEATURE;
   }
-  char *apath = map_path->abstract_path(map_path->handle, self->scala_file);
+  char *apath = map_path->abstract_path(map_path->handle, self->tuning->scala_file);
   if (!apath) {
-    fprintf(stderr, "abstract_path() returned NULL\n");
+    LOG(LOG_ERROR, "abstract_path() returned NULL\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
   LV2_State_Status status =
@@ -522,7 +517,7 @@ static LV2_State_Status save(LV2_Handle instance,
 	     LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE);
   free(apath);
   if (status != LV2_STATE_SUCCESS) {
-    fprintf(stderr, "store_fn failed\n");
+    LOG(LOG_ERROR, "store_fn failed\n");
   }
   return status;
 }
@@ -532,7 +527,7 @@ static LV2_State_Status restore(LV2_Handle instance,
 				LV2_State_Handle handle,
 				uint32_t flags,
 				const LV2_Feature * const *features) {
-  fprintf(stderr, "restore\n");
+  LOG(LOG_DEBUG, "restore\n");
   struct synth *self = instance;
   size_t size;
   LV2_URID type;
@@ -542,31 +537,55 @@ static LV2_State_Status restore(LV2_Handle instance,
 		self->uris.scala_file,
 		&size, &type, &valflags);
   if (!scala_file) {
-    fprintf(stderr, "Failed to retrieve scala file state\n");
+    LOG(LOG_ERROR, "Failed to retrieve scala file state\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
   if (size == 0 || size > PATH_MAX) {
-    fprintf(stderr, "Bad scala file path length %zi\n", size);
+    LOG(LOG_ERROR, "Bad scala file path length %zi\n", size);
     return LV2_STATE_ERR_UNKNOWN;
   }
   if (scala_file[size-1] != '\0') {
-    fprintf(stderr, "Scala file not null terminated!\n");
+    LOG(LOG_ERROR, "Scala file not null terminated!\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
-  fprintf(stderr, "Scala file: %s\n", scala_file);
-  if (!set_scala_file(self, scala_file)) {
+  LOG(LOG_DEBUG, "Scala file: %s\n", scala_file);
+  struct tuning *t = tuning_load(scala_file);
+  if (!t) {
     return LV2_STATE_ERR_UNKNOWN;
   }
+  free(self->tuning);
+  self->tuning = t;
   return LV2_STATE_SUCCESS;
 }
 
+static LV2_Worker_Status work(LV2_Handle instance,
+			      LV2_Worker_Respond_Function respond,
+			      LV2_Worker_Respond_Handle handle,
+			      uint32_t size,
+			      const void *data) {
+  return tuning_work(respond, handle, size, data);
+}
+
+static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size, const void *data) {
+  struct synth *self = instance;
+  struct tuning *t = tuning_response(size, data);
+  if (t) {
+    tuning_schedule_free(self->schedule, self->tuning, &self->log);
+    self->tuning = t;
+  }
+  return LV2_WORKER_SUCCESS;
+}
+
 static const void *extension_data(const char *uri) {
-  fprintf(stderr, "extension_data\n");
+  LOG(LOG_DEBUG, "extension_data\n");
   if (!strcmp(uri, LV2_STATE__interface)) {
     static const LV2_State_Interface state = { save, restore };
     return &state;
+  } else if (!strcmp(uri, LV2_WORKER__interface)) {
+    static const LV2_Worker_Interface worker = { work, work_response, NULL };
+    return &worker;
   } else {
-    fprintf(stderr, "Unknown extension data requested: %s\n", uri);
+    LOG(LOG_INFO, "Unknown extension data requested: %s\n", uri);
   }
   return NULL;
 }
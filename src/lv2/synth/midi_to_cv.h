@@ -1,18 +1,14 @@
-#include "../../tuning/scala.h"
-
 struct midi_to_cv {
   uint8_t note;
   uint8_t velocity;
   bool trigger;
   bool retrigger;
-  float freq[128];
+  const float *freq; // the current tuning, swapped by the plugin
 };
 
-static void midi_to_cv_init(struct midi_to_cv *self) {
-  fprintf(stderr, "%s\n", __func__);
-  for (int i = 0; i < 128; i++) {
-    self->freq[i] = 440 * pow(2.0, (i - 69) / 12.0);
-  }
+static void midi_to_cv_init(struct midi_to_cv *self, const float *freq) {
+  LOG(LOG_DEBUG, "%s\n", __func__);
+  self->freq = freq;
 }
 
 static void midi_to_cv_handle_midi(struct midi_to_cv *self, const uint8_t *msg) {
@@ -50,13 +46,3 @@ static struct cv midi_to_cv_get_cv(struct midi_to_cv *self) {
   self->retrigger = false;
   return cv;
 }
-
-static bool midi_to_cv_load_scala_file(struct midi_to_cv *self, const char *filename) {
-  fprintf(stderr, "%s\n", __func__);
-  float cents[128];
-  if (!load_scala_file(filename, cents, self->freq)) {
-    fprintf(stderr, "Failed to load scala file %s\n", filename);
-    return false;
-  }
-  return true;
-}
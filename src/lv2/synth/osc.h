@@ -14,7 +14,7 @@ static void osc_tick_phase(struct osc *self, double freq) {
 static double osc_tick_sin(struct osc *self, double freq) {
   double phase = self->phase;
   osc_tick_phase(self, freq);
-  return sin(2*3.141592*phase);
+  return fast_sin(2*3.141592*phase);
 }
 
 static double osc_tick_saw(struct osc *self, double freq) {
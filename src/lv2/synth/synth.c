@@ -10,15 +10,22 @@
 #include "lv2/lv2plug.in/ns/ext/patch/patch.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
 #include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #define SYNTH_URI "urn:magnusjonsson:mjack:lv2:synth"
 
+#include "../util/log.h"
 #include "../util/lv2utils.h"
 #include "../util/uris.h"
+#include "../../wrappers/rtcheck.h"
+#include "../../tuning/scala.h"
+#include "../util/tuning.h"
 
 #include "cv.h"
 #include "midi_to_cv.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../../dsp/fastmath.h"
 #include "osc.h"
 #include "env.h"
 
@@ -51,11 +58,13 @@ struct synth {
 
   LV2_URID_Map *map;
   LV2_URID_Unmap *unmap;
+  LV2_Worker_Schedule *schedule;
 
   LV2_Atom_Forge forge;
   LV2_Atom_Forge_Frame notify_frame;
 
   struct uris uris;
+  struct log log;
   
   const LV2_Atom_Sequence *control;
   const LV2_Atom_Sequence *notify;
@@ -72,7 +81,7 @@ struct synth {
   const float *release;
   const float *retrigger;
 
-  char scala_file[PATH_MAX];
+  struct tuning *tuning;
 
   struct osc vibrato_lfo[NUM_VIBRATOS];
 
@@ -85,31 +94,43 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
 			      double sample_rate,
 			      const char *bundle_path,
 			      const LV2_Feature *const *host_features) {
-  fprintf(stderr, "instantiate\n");
+  LOG(LOG_DEBUG, "instantiate\n");
   struct synth *self = calloc(1, sizeof(struct synth));
   self->dt = 1.0 / sample_rate;
   self->map = get_host_feature(host_features, LV2_URID__map);
   self->unmap = get_host_feature(host_features, LV2_URID__unmap);
   if (!self->map) {
-    fprintf(stderr, "Could not get URID map host feature\n");
+    LOG(LOG_ERROR, "Could not get URID map host feature\n");
     goto err;
   }
   if (!self->unmap) {
-    fprintf(stderr, "Could not get URID unmap host feature\n");
+    LOG(LOG_ERROR, "Could not get URID unmap host feature\n");
     goto err;
   }
-  fprintf(stderr, "Mapping uris\n");
+  self->schedule = get_host_feature(host_features, LV2_WORKER__schedule);
+  if (!self->schedule) {
+    LOG(LOG_ERROR, "Could not get worker schedule host feature\n");
+    goto err;
+  }
+  LOG(LOG_DEBUG, "Mapping uris\n");
   uris_init(&self->uris, self->map);
 
-  fprintf(stderr, "initializing forge\n");
+  LOG(LOG_DEBUG, "initializing forge\n");
   lv2_atom_forge_init(&self->forge, self->map);
 
-  midi_to_cv_init(&self->midi_to_cv);
+  self->tuning = tuning_new_equal(69);
+  if (!self->tuning) {
+    goto err;
+  }
+  midi_to_cv_init(&self->midi_to_cv, self->tuning->freq);
+
+  log_start(&self->log, "synth");
 
-  fprintf(stderr, "instantiate done\n");
+  LOG(LOG_DEBUG, "instantiate done\n");
   return self;
  err:
-  fprintf(stderr, "instantiate error\n");
+  LOG(LOG_ERROR, "instantiate error\n");
+  free(self->tuning);
   free(self);
   return NULL;
 }
@@ -140,7 +161,7 @@ static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
 }
 
 static void activate(LV2_Handle instance) {
-  fprintf(stderr, "activate\n");
+  LOG(LOG_DEBUG, "activate\n");
 }
 
 static void handle_midi(struct synth *self, const uint8_t *msg) {
@@ -241,33 +262,21 @@ static void run_audio(struct synth *self, uint32_t offset, uint32_t end) {
   // TODO add allpass filters
 }
 
-static bool set_scala_file(struct synth *self, const char *filename) {
-  if (strlen(filename) < PATH_MAX) {
-    strncpy(self->scala_file, filename, PATH_MAX);
-    // TODO do this in worker thread
-    midi_to_cv_load_scala_file(&self->midi_to_cv, self->scala_file);
-    return true;
-  } else {
-    fprintf(stderr, "Scala file path too long!\n");
-    return false;
-  }
-}
-
 static void handle_patch_set(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch set\n");
-  const char *filename = read_set_scala_file(obj, &self->uris);
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch set\n");
+  const char *filename = read_set_scala_file(obj, &self->uris, &self->log);
   if (filename) {
-    fprintf(stderr, "scala file name: %s\n", filename);
-    set_scala_file(self, filename);
+    LOG_RT(&self->log, LOG_DEBUG, "scala file name: %s\n", filename);
+    tuning_schedule_load(self->schedule, filename, &self->log);
   } else {
-    fprintf(stderr, "Could not get scala filename from patch_Set");
+    LOG_RT(&self->log, LOG_WARNING, "Could not get scala filename from patch_set\n");
   }
 }
 
 static void handle_patch_get(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch get\n");
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch get\n");
   lv2_atom_forge_frame_time(&self->forge, frames);
-  write_set_scala_file(&self->forge, &self->uris, self->scala_file);
+  write_set_scala_file(&self->forge, &self->uris, self->tuning->scala_file);
 }
 
 static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
@@ -278,12 +287,13 @@ static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, i
     handle_patch_get(self, obj, frames);
   }
   else {
-    fprintf(stderr, "Unknown atom object body type: %s", self->unmap->unmap(self->unmap->handle, obj->body.otype));
+    LOG_RT(&self->log, LOG_WARNING, "Unknown atom object body type %u\n", obj->body.otype);
   }
 }
 
 static void run(LV2_Handle handle, uint32_t nframes) {
   struct synth *self = handle;
+  RTCHECK_ENTER("LV2 run");
 
   const uint32_t notify_capacity = self->notify->atom.size;
   lv2_atom_forge_set_buffer(&self->forge,
@@ -303,20 +313,24 @@ static void run(LV2_Handle handle, uint32_t nframes) {
       handle_atom_object(self, obj, offset);
     }
     else {
-      fprintf(stderr, "Unknown event type: %s", self->unmap->unmap(self->unmap->handle, ev->body.type));
+      LOG_RT(&self->log, LOG_WARNING, "Unknown event type %u\n", ev->body.type);
     }
     offset = ev->time.frames;
   }
   run_audio(self, offset, nframes);
+  RTCHECK_LEAVE();
 }
 
 static void deactivate(LV2_Handle instance) {
-  fprintf(stderr, "deactivate\n");
+  LOG(LOG_DEBUG, "deactivate\n");
 }
 
 static void cleanup(LV2_Handle instance) {
-  fprintf(stderr, "cleanup\n");
-  free(instance);
+  LOG(LOG_DEBUG, "cleanup\n");
+  struct synth *self = instance;
+  log_stop(&self->log);
+  free(self->tuning);
+  free(self);
 }
 
 static LV2_State_Status save(LV2_Handle instance,
@@ -330,9 +344,9 @@ static LV2_State_Status save(LV2_Handle instance,
   if (!map_path) {
     return LV2_STATE_ERR_NO_FEATURE;
   }
-  char *apath = map_path->abstract_path(map_path->handle, self->scala_file);
+  char *apath = map_path->abstract_path(map_path->handle, self->tuning->scala_file);
   if (!apath) {
-    fprintf(stderr, "abstract_path() returned NULL\n");
+    LOG(LOG_ERROR, "abstract_path() returned NULL\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
   LV2_State_Status status =
@@ -360,31 +374,57 @@ static LV2_State_Status restore(LV2_Handle instance,
 		self->uris.scala_file,
 		&size, &type, &valflags);
   if (!scala_file) {
-    fprintf(stderr, "Failed to retrieve scala file state\n");
+    LOG(LOG_ERROR, "Failed to retrieve scala file state\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
   if (size == 0 || size > PATH_MAX) {
-    fprintf(stderr, "Bad scala file path length %zi\n", size);
+    LOG(LOG_ERROR, "Bad scala file path length %zi\n", size);
     return LV2_STATE_ERR_UNKNOWN;
   }
   if (scala_file[size-1] != '\0') {
-    fprintf(stderr, "Scala file not null terminated!\n");
+    LOG(LOG_ERROR, "Scala file not null terminated!\n");
     return LV2_STATE_ERR_UNKNOWN;
   }
-  fprintf(stderr, "Scala file: %s\n", scala_file);
-  if (!set_scala_file(self, scala_file)) {
+  LOG(LOG_DEBUG, "Scala file: %s\n", scala_file);
+  struct tuning *t = tuning_load(scala_file);
+  if (!t) {
     return LV2_STATE_ERR_UNKNOWN;
   }
+  free(self->tuning);
+  self->tuning = t;
+  self->midi_to_cv.freq = t->freq;
   return LV2_STATE_SUCCESS;
 }
 
+static LV2_Worker_Status work(LV2_Handle instance,
+			      LV2_Worker_Respond_Function respond,
+			      LV2_Worker_Respond_Handle handle,
+			      uint32_t size,
+			      const void *data) {
+  return tuning_work(respond, handle, size, data);
+}
+
+static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size, const void *data) {
+  struct synth *self = instance;
+  struct tuning *t = tuning_response(size, data);
+  if (t) {
+    tuning_schedule_free(self->schedule, self->tuning, &self->log);
+    self->tuning = t;
+    self->midi_to_cv.freq = t->freq;
+  }
+  return LV2_WORKER_SUCCESS;
+}
+
 static const void *extension_data(const char *uri) {
-  fprintf(stderr, "extension_data\n");
+  LOG(LOG_DEBUG, "extension_data\n");
   if (!strcmp(uri, LV2_STATE__interface)) {
     static const LV2_State_Interface state = { save, restore };
     return &state;
+  } else if (!strcmp(uri, LV2_WORKER__interface)) {
+    static const LV2_Worker_Interface worker = { work, work_response, NULL };
+    return &worker;
   } else {
-    fprintf(stderr, "Unknown extension data requested: %s\n", uri);
+    LOG(LOG_INFO, "Unknown extension data requested: %s\n", uri);
   }
   return NULL;
 }
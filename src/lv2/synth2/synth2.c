@@ -10,13 +10,17 @@
 #include "lv2/lv2plug.in/ns/ext/patch/patch.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
 #include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #define SYNTH_URI "urn:magnusjonsson:mjack:lv2:synth2"
 
+#include "../util/log.h"
 #include "../util/lv2utils.h"
 #include "../util/uris.h"
+#include "../../wrappers/rtcheck.h"
 #include "../../tuning/scala.h"
+#include "../util/tuning.h"
 
 #define NUM_VOICES 128
 
@@ -103,16 +107,18 @@ struct synth {
 
   LV2_URID_Map *map;
   LV2_URID_Unmap *unmap;
+  LV2_Worker_Schedule *schedule;
 
   LV2_Atom_Forge forge;
   LV2_Atom_Forge_Frame notify_frame;
   struct uris uris;
+  struct log log;
 
   const LV2_Atom_Sequence *control;
   const LV2_Atom_Sequence *notify;
   float *out;
   struct params params;
-  char scala_file[PATH_MAX];
+  struct tuning *tuning;
 
   struct voice voice[128];
 
@@ -122,43 +128,49 @@ static LV2_Handle instantiate(const LV2_Descriptor *descriptor,
 			      double sample_rate,
 			      const char *bundle_path,
 			      const LV2_Feature *const *host_features) {
-  fprintf(stderr, "Instantiating\n");
+  LOG(LOG_DEBUG, "Instantiating\n");
   struct synth *self;
   {
     self = calloc(1, sizeof(struct synth));
     self->dt = 1.0 / sample_rate;
   }
 
-  fprintf(stderr, "Getting mappers\n");
+  LOG(LOG_DEBUG, "Getting mappers\n");
   {
     self->map = get_host_feature(host_features, LV2_URID__map);
-    if (!self->map) { fprintf(stderr, "Could not get URID map host feature\n"); goto err; }
+    if (!self->map) { LOG(LOG_ERROR, "Could not get URID map host feature\n"); goto err; }
     self->unmap = get_host_feature(host_features, LV2_URID__unmap);
-    if (!self->unmap) { fprintf(stderr, "Could not get URID unmap host feature\n"); goto err; }
+    if (!self->unmap) { LOG(LOG_ERROR, "Could not get URID unmap host feature\n"); goto err; }
+    self->schedule = get_host_feature(host_features, LV2_WORKER__schedule);
+    if (!self->schedule) { LOG(LOG_ERROR, "Could not get worker schedule host feature\n"); goto err; }
   }
 
-  fprintf(stderr, "Mapping uris\n");
+  LOG(LOG_DEBUG, "Mapping uris\n");
   {
     uris_init(&self->uris, self->map);
   }
 
-  fprintf(stderr, "Initializing forge\n");
+  LOG(LOG_DEBUG, "Initializing forge\n");
   {
     lv2_atom_forge_init(&self->forge, self->map);
   }
 
-  fprintf(stderr, "Initializing voices\n");
+  LOG(LOG_DEBUG, "Initializing voices\n");
   {
+    self->tuning = tuning_new_equal(60);
+    if (!self->tuning) { goto err; }
     for (int i = 0; i < 128; i++) {
-      double freq = 440.0 * pow(2.0, (i - 60.0) / 12.0);
-      voice_init(&self->voice[i], freq);
+      voice_init(&self->voice[i], self->tuning->freq[i]);
     }
   }
 
-  fprintf(stderr, "Done\n");
+  log_start(&self->log, "synth2");
+
+  LOG(LOG_DEBUG, "Done\n");
   return self;
  err:
-  fprintf(stderr, "Could not initialize\n");
+  LOG(LOG_ERROR, "Could not initialize\n");
+  free(self->tuning);
   free(self);
   return NULL;
 }
@@ -176,7 +188,7 @@ static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
 }
 
 static void activate(LV2_Handle instance) {
-  fprintf(stderr, "activate()\n");
+  LOG(LOG_DEBUG, "activate()\n");
 }
 
 static void handle_note_on(struct synth *self, int note, int velocity) {
@@ -210,40 +222,21 @@ static void run_audio(struct synth *self, uint32_t offset, uint32_t end) {
   }
 }
 
-static bool set_scala_file(struct synth *self, const char *filename) {
-  if (strlen(filename) < PATH_MAX) {
-    strncpy(self->scala_file, filename, PATH_MAX);
-    float cents[128];
-    float freq[128];
-    if (!load_scala_file(filename, cents, freq)) {
-      fprintf(stderr, "Failed to load scala file %s\n", filename);
-      return false;
-    }
-    for (int i = 0; i < 128; i++) {
-      self->voice[i].freq = freq[i];
-    }
-    return true;
-  } else {
-    fprintf(stderr, "Scala file path too long!\n");
-    return false;
-  }
-}
-
 static void handle_patch_set(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch set\n");
-  const char *filename = read_set_scala_file(obj, &self->uris);
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch set\n");
+  const char *filename = read_set_scala_file(obj, &self->uris, &self->log);
   if (filename) {
-    fprintf(stderr, "scala file name: %s\n", filename);
-    set_scala_file(self, filename);
+    LOG_RT(&self->log, LOG_DEBUG, "scala file name: %s\n", filename);
+    tuning_schedule_load(self->schedule, filename, &self->log);
   } else {
-    fprintf(stderr, "Could not get scala filename from patch_Set");
+    LOG_RT(&self->log, LOG_WARNING, "Could not get scala filename from patch_set\n");
   }
 }
 
 static void handle_patch_get(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
-  fprintf(stderr, "Got patch get\n");
+  LOG_RT(&self->log, LOG_DEBUG, "Got patch get\n");
   lv2_atom_forge_frame_time(&self->forge, frames);
-  write_set_scala_file(&self->forge, &self->uris, self->scala_file);
+  write_set_scala_file(&self->forge, &self->uris, self->tuning->scala_file);
 }
 
 static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, int64_t frames) {
@@ -254,12 +247,13 @@ static void handle_atom_object(struct synth *self, const LV2_Atom_Object *obj, i
     handle_patch_get(self, obj, frames);
   }
   else {
-    fprintf(stderr, "Unknown atom object body type: %s", self->unmap->unmap(self->unmap->handle, obj->body.otype));
+    LOG_RT(&self->log, LOG_WARNING, "Unknown atom object body type %u\n", obj->body.otype);
   }
 }
 
 static void run(LV2_Handle handle, uint32_t nframes) {
   struct synth *self = handle;
+  RTCHECK_ENTER("LV2 run");
 
   const uint32_t notify_capacity = self->notify->atom.size;
   lv2_atom_forge_set_buffer(&self->forge,
@@ -279,25 +273,55 @@ static void run(LV2_Handle handle, uint32_t nframes) {
       handle_atom_object(self, obj, offset);
     }
     else {
-      fprintf(stderr, "Unknown event type: %s", self->unmap->unmap(self->unmap->handle, ev->body.type));
+      LOG_RT(&self->log, LOG_WARNING, "Unknown event type %u\n", ev->body.type);
     }
     offset = ev->time.frames;
   }
   run_audio(self, offset, nframes);
+  RTCHECK_LEAVE();
 }
 
 static void deactivate(LV2_Handle instance) {
-  fprintf(stderr, "deactivate\n");
+  LOG(LOG_DEBUG, "deactivate\n");
 }
 
 static void cleanup(LV2_Handle instance) {
-  fprintf(stderr, "cleanup\n");
-  free(instance);
+  LOG(LOG_DEBUG, "cleanup\n");
+  struct synth *self = instance;
+  log_stop(&self->log);
+  free(self->tuning);
+  free(self);
+}
+
+static LV2_Worker_Status work(LV2_Handle instance,
+			      LV2_Worker_Respond_Function respond,
+			      LV2_Worker_Respond_Handle handle,
+			      uint32_t size,
+			      const void *data) {
+  return tuning_work(respond, handle, size, data);
+}
+
+static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size, const void *data) {
+  struct synth *self = instance;
+  struct tuning *t = tuning_response(size, data);
+  if (t) {
+    tuning_schedule_free(self->schedule, self->tuning, &self->log);
+    self->tuning = t;
+    for (int i = 0; i < 128; i++) {
+      self->voice[i].freq = t->freq[i];
+    }
+  }
+  return LV2_WORKER_SUCCESS;
 }
 
 static const void *extension_data(const char *uri) {
-  fprintf(stderr, "extension_data\n");
-  fprintf(stderr, "Unknown extension data requested: %s\n", uri);
+  LOG(LOG_DEBUG, "extension_data\n");
+  if (!strcmp(uri, LV2_WORKER__interface)) {
+    static const LV2_Worker_Interface worker = { work, work_response, NULL };
+    return &worker;
+  } else {
+    LOG(LOG_INFO, "Unknown extension data requested: %s\n", uri);
+  }
   return NULL;
 }
 
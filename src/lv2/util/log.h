@@ -0,0 +1,113 @@
+// Logging for the LV2 plugins.
+//
+// LOG writes straight to stderr and is for the instantiation and state
+// callbacks. LOG_RT is for run() and everything it calls: the message is
+// formatted into a fixed-size record of a single-producer single-consumer
+// ring and the audio thread never blocks or allocates. When the ring is full
+// the message is dropped and counted. A drain thread, started with the
+// instance by log_start, prints the records; log_stop prints whatever is left.
+//
+// Messages below LOG_LEVEL are compiled out. Debug builds log everything,
+// release builds (-DNDEBUG) only warnings and errors.
+//
+//   log_start(&self->log, "synth");
+//   LOG_RT(&self->log, LOG_WARNING, "Unknown event type %u\n", type);
+//   log_stop(&self->log);
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARNING 2
+#define LOG_ERROR 3
+
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_WARNING
+#else
+#define LOG_LEVEL LOG_DEBUG
+#endif
+#endif
+
+#define LOG_RING_SIZE 64 // records, a power of two
+#define LOG_RECORD_LEN 128
+#define LOG_DRAIN_MS 50
+
+#define LOG(level, ...) do { if ((level) >= LOG_LEVEL) fprintf(stderr, __VA_ARGS__); } while (0)
+#define LOG_RT(log, level, ...) do { if ((level) >= LOG_LEVEL) log_write(log, __VA_ARGS__); } while (0)
+
+struct log_record {
+  char text[LOG_RECORD_LEN];
+};
+
+struct log {
+  const char *name;
+  struct log_record record[LOG_RING_SIZE];
+  unsigned write; // only advanced by the producer
+  unsigned read;  // only advanced by the drain thread
+  unsigned dropped;
+  unsigned dropped_reported;
+  bool running;
+  pthread_t thread;
+};
+
+__attribute__((format(printf, 2, 3)))
+static inline void log_write(struct log *log, const char *format, ...) {
+  unsigned w = log->write;
+  if (w - __atomic_load_n(&log->read, __ATOMIC_ACQUIRE) == LOG_RING_SIZE) {
+    __atomic_store_n(&log->dropped, log->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  vsnprintf(log->record[w & (LOG_RING_SIZE - 1)].text, LOG_RECORD_LEN, format, args);
+  va_end(args);
+  __atomic_store_n(&log->write, w + 1, __ATOMIC_RELEASE);
+}
+
+static inline void log_drain(struct log *log) {
+  unsigned w = __atomic_load_n(&log->write, __ATOMIC_ACQUIRE);
+  for (unsigned r = log->read; r != w; r++) {
+    fprintf(stderr, "%s: %s", log->name, log->record[r & (LOG_RING_SIZE - 1)].text);
+    __atomic_store_n(&log->read, r + 1, __ATOMIC_RELEASE);
+  }
+  unsigned dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+  if (dropped != log->dropped_reported) {
+    fprintf(stderr, "%s: %u log messages dropped\n", log->name, dropped - log->dropped_reported);
+    log->dropped_reported = dropped;
+  }
+}
+
+static void *log_thread(void *arg) {
+  struct log *log = arg;
+  const struct timespec period = { 0, LOG_DRAIN_MS * 1000000 };
+  while (__atomic_load_n(&log->running, __ATOMIC_ACQUIRE)) {
+    log_drain(log);
+    nanosleep(&period, NULL);
+  }
+  return NULL;
+}
+
+static inline void log_start(struct log *log, const char *name) {
+  log->name = name;
+  log->write = log->read = 0;
+  log->dropped = log->dropped_reported = 0;
+  // Set before the thread starts, which would otherwise find it false and exit
+  __atomic_store_n(&log->running, true, __ATOMIC_RELEASE);
+  if (pthread_create(&log->thread, NULL, log_thread, log)) {
+    log->running = false;
+    fprintf(stderr, "%s: could not start the log thread, realtime messages are printed on cleanup\n", name);
+  }
+}
+
+static inline void log_stop(struct log *log) {
+  if (log->running) {
+    __atomic_store_n(&log->running, false, __ATOMIC_RELEASE);
+    pthread_join(log->thread, NULL);
+  }
+  log_drain(log);
+}
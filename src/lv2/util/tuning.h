@@ -0,0 +1,132 @@
+// Scala tunings for the LV2 synths, loaded by the LV2 worker.
+//
+// run() never touches the file system. On patch:Set it calls
+// tuning_schedule_load, and the host runs tuning_work on its worker thread,
+// which parses the file into a freshly allocated table. The table comes back
+// through work_response, where the plugin swaps its tuning pointer between
+// two blocks and hands the old table to tuning_schedule_free. The worker
+// frees it.
+//
+//   work:          return tuning_work(respond, handle, size, data);
+//   work_response: struct tuning *t = tuning_response(size, data);
+//                  if (t) {
+//                    tuning_schedule_free(self->schedule, self->tuning, &self->log);
+//                    self->tuning = t;
+//                  }
+//
+// State restore is not concurrent with run(), so it loads with tuning_load
+// and swaps directly.
+
+#define TUNING_NUM_NOTES 128
+
+struct tuning {
+  float freq[TUNING_NUM_NOTES];
+  char scala_file[PATH_MAX];
+};
+
+enum tuning_work_type {
+  TUNING_WORK_LOAD,
+  TUNING_WORK_FREE,
+};
+
+struct tuning_work {
+  uint32_t type;
+  struct tuning *tuning; // TUNING_WORK_FREE
+  char scala_file[];     // TUNING_WORK_LOAD, null terminated
+};
+
+// Equal temperament with A440 on note a4.
+static struct tuning *tuning_new_equal(int a4) {
+  struct tuning *t = calloc(1, sizeof(struct tuning));
+  if (!t) return NULL;
+  for (int i = 0; i < TUNING_NUM_NOTES; i++) {
+    t->freq[i] = 440.0 * pow(2.0, (i - a4) / 12.0);
+  }
+  return t;
+}
+
+static struct tuning *tuning_load(const char *filename) {
+  if (strlen(filename) >= PATH_MAX) {
+    LOG(LOG_ERROR, "Scala file path too long!\n");
+    return NULL;
+  }
+  struct tuning *t = calloc(1, sizeof(struct tuning));
+  if (!t) return NULL;
+  float cents[TUNING_NUM_NOTES];
+  if (!load_scala_file(filename, cents, t->freq)) {
+    LOG(LOG_ERROR, "Failed to load scala file %s\n", filename);
+    free(t);
+    return NULL;
+  }
+  strcpy(t->scala_file, filename);
+  return t;
+}
+
+static bool tuning_schedule_load(LV2_Worker_Schedule *schedule, const char *filename, struct log *log) {
+  struct {
+    struct tuning_work work;
+    char scala_file[PATH_MAX];
+  } msg;
+  size_t len = strlen(filename);
+  if (len >= PATH_MAX) {
+    LOG_RT(log, LOG_ERROR, "Scala file path too long!\n");
+    return false;
+  }
+  msg.work.type = TUNING_WORK_LOAD;
+  msg.work.tuning = NULL;
+  memcpy(msg.work.scala_file, filename, len + 1);
+  if (schedule->schedule_work(schedule->handle, sizeof(struct tuning_work) + len + 1, &msg)) {
+    LOG_RT(log, LOG_ERROR, "Could not schedule loading scala file %s\n", filename);
+    return false;
+  }
+  return true;
+}
+
+static void tuning_schedule_free(LV2_Worker_Schedule *schedule, struct tuning *t, struct log *log) {
+  if (!t) return;
+  struct tuning_work msg = { .type = TUNING_WORK_FREE, .tuning = t };
+  if (schedule->schedule_work(schedule->handle, sizeof(msg), &msg)) {
+    LOG_RT(log, LOG_WARNING, "Could not schedule freeing the old tuning, leaking it\n");
+  }
+}
+
+static LV2_Worker_Status tuning_work(LV2_Worker_Respond_Function respond,
+				     LV2_Worker_Respond_Handle handle,
+				     uint32_t size,
+				     const void *data) {
+  const struct tuning_work *msg = data;
+  if (size < sizeof(struct tuning_work)) {
+    return LV2_WORKER_ERR_UNKNOWN;
+  }
+  switch (msg->type) {
+  case TUNING_WORK_FREE:
+    free(msg->tuning);
+    return LV2_WORKER_SUCCESS;
+  case TUNING_WORK_LOAD:
+    {
+      if (((const char *) data)[size - 1] != '\0') {
+	LOG(LOG_ERROR, "Scala file not null terminated!\n");
+	return LV2_WORKER_ERR_UNKNOWN;
+      }
+      LOG(LOG_DEBUG, "Loading scala file %s\n", msg->scala_file);
+      struct tuning *t = tuning_load(msg->scala_file);
+      if (!t) {
+	return LV2_WORKER_ERR_UNKNOWN;
+      }
+      LV2_Worker_Status status = respond(handle, sizeof(t), &t);
+      if (status != LV2_WORKER_SUCCESS) {
+	free(t);
+      }
+      return status;
+    }
+  default:
+    return LV2_WORKER_ERR_UNKNOWN;
+  }
+}
+
+static struct tuning *tuning_response(uint32_t size, const void *data) {
+  if (size != sizeof(struct tuning *)) return NULL;
+  struct tuning *t;
+  memcpy(&t, data, sizeof(t));
+  return t;
+}
@@ -37,35 +37,36 @@ static void write_set_scala_file(LV2_Atom_Forge *forge,
 }
 
 static const char *read_set_scala_file(const LV2_Atom_Object *obj,
-				       const struct uris *uris) {
+				       const struct uris *uris,
+				       struct log *log) {
   if (obj->body.otype != uris->patch_set) {
-   fprintf(stderr, "body type is not patch set!");
+    LOG_RT(log, LOG_WARNING, "body type is not patch set!\n");
     return NULL;    
   }
   const LV2_Atom *property = NULL;
   lv2_atom_object_get(obj, uris->patch_property, &property, 0);
   if (!property) {
-    fprintf(stderr, "Malformed set message has no body.\n");
+    LOG_RT(log, LOG_WARNING, "Malformed set message has no body.\n");
     return NULL;
   }
   if (property->type != uris->atom_urid) {
-    fprintf(stderr, "Malformed set message has non-URID property.\n");
+    LOG_RT(log, LOG_WARNING, "Malformed set message has non-URID property.\n");
     return NULL;
   }
   const LV2_Atom_URID *urid = (const LV2_Atom_URID *) property;
   if (urid->body != uris->scala_file) {
-    fprintf(stderr, "Set message for unknown property.\n");
+    LOG_RT(log, LOG_WARNING, "Set message for unknown property.\n");
     return NULL;
   }
 
   const LV2_Atom *value = NULL;
   lv2_atom_object_get(obj, uris->patch_value, &value, 0);
   if (!value) {
-    fprintf(stderr, "Malformed set message has no value.\n");
+    LOG_RT(log, LOG_WARNING, "Malformed set message has no value.\n");
     return NULL;
   }
   if (value->type != uris->atom_path) {
-    fprintf(stderr, "Set message value is not a Path.\n");
+    LOG_RT(log, LOG_WARNING, "Set message value is not a Path.\n");
     return NULL;
   }
 
@@ -5,6 +5,8 @@
 #include <malloc.h>
 #include "../dsp/ap.h"
 #include "../wrappers/wrapper.h"
+#include "../dsp/fastmath.h"
+#include "../dsp/prewarp.h"
 
 const char* plugin_name = "APChain";
 const char* plugin_persistence_name = "mjack_apchain";
@@ -20,18 +22,19 @@ struct apchain {
   float *outbuf;
 
   double dt;
+  struct prewarp ap_table;
 
   double apstate[MAX_STAGES];
 };
 
 static void init(struct apchain* a, double nframes_per_second) {
   a->dt = 1.0 / nframes_per_second;
+  prewarp_init(&a->ap_table, nframes_per_second, ap_coeff);
 }
 
 void plugin_process(struct instance* instance, int nframes) {
   struct apchain *a = instance->plugin;
-  double freq = 440.0 * pow(2.0, (instance->wrapper_cc[CC_CUTOFF] - 69) / 12.0);
-  double k = ap_coeff(freq * a->dt);
+  double k = prewarp_pitch(&a->ap_table, instance->wrapper_cc[CC_CUTOFF]);
   int num_stages = 1 + instance->wrapper_cc[CC_STAGES];
   FOR(f, nframes) {
     double x = a->inbuf[f] + 1e-12;
@@ -42,6 +45,13 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  PLUGIN_CC(CC_CUTOFF, "Cutoff"),
+  PLUGIN_CC(CC_STAGES, "Stages"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   printf("Apchain init\n");
   struct apchain *a = calloc(1, sizeof(struct apchain));
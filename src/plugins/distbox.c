@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
 #include <malloc.h>
@@ -6,7 +7,10 @@
 #include <string.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 #include "../dsp/biquad.h"
+#include "../dsp/smooth.h"
 
 const char* plugin_name = "DistBox";
 const char* plugin_persistence_name = "mjack_distbox";
@@ -29,6 +33,10 @@ enum {
 #undef X
 };
 
+#define SMOOTH_SECONDS 0.03
+
+enum { S_FREQ, S_Q, S_LOW_GAIN, S_MID_GAIN, S_HIGH_GAIN };
+
 struct mjack_biquad {
   float *in;
   float *out;
@@ -36,6 +44,15 @@ struct mjack_biquad {
   double dt;
   struct biquad_state pre;
   struct biquad_state post;
+
+  // At the end of the last block
+  struct biquad_norm pre_coeffs;
+  struct biquad_norm post_coeffs;
+  struct smooth smooth;
+
+  // Set by cc_changed
+  double drive, bias, tanh_bias;
+  double dry, wet;
 };
 
 static void init(struct mjack_biquad *m, double sample_rate) {
@@ -48,48 +65,96 @@ static double cc_gain(double cc) {
   return (1 + f) / (2 - f);
 }
 
-void plugin_process(struct instance* instance, int nframes) {
-  struct mjack_biquad *m = instance->plugin;
-
-  double f = 440 * pow(2.0, (instance->wrapper_cc[CC_FREQ] - 69) / 12.0);
+static void set_coeffs(struct mjack_biquad *m, const float *cc) {
+  double f = 440 * pow(2.0, (cc[S_FREQ] - 69) / 12.0);
 
   struct biquad_params params = {
     .w = 2 * 3.141592 * f * m->dt,
-    .Q = (1 + instance->wrapper_cc[CC_Q]) * 4 / 128.0,
-    .g2 = cc_gain(instance->wrapper_cc[CC_HIGH_GAIN]),
-    .g1 = cc_gain(instance->wrapper_cc[CC_MID_GAIN]),
-    .g0 = cc_gain(instance->wrapper_cc[CC_LOW_GAIN]),
+    .Q = (1 + cc[S_Q]) * 4 / 128.0,
+    .g2 = cc_gain(cc[S_HIGH_GAIN]),
+    .g1 = cc_gain(cc[S_MID_GAIN]),
+    .g0 = cc_gain(cc[S_LOW_GAIN]),
   };
 
-  double drive = cc_gain(instance->wrapper_cc[CC_DRIVE]);
-  double bias = instance->wrapper_cc[CC_BIAS] / 127.0;
-  double tanh_bias = tanh(bias);
-  double dry = pow(instance->wrapper_cc[CC_DRY] / 127.0, 2);
-  double wet = pow(instance->wrapper_cc[CC_WET] / 127.0, 2);
+  struct biquad_coeffs pre = biquad_digital_parametric(params);
+  m->pre_coeffs = biquad_normalize(pre);
+  m->post_coeffs = biquad_normalize(biquad_invert(pre));
+}
 
-  struct biquad_coeffs pre_coeffs = biquad_digital_parametric(params);
+static void cc_changed(struct instance* instance) {
+  struct mjack_biquad *m = instance->plugin;
 
-  biquad_process(pre_coeffs, &m->pre, m->in, m->out, nframes);
+  m->drive = cc_gain(instance->wrapper_cc[CC_DRIVE]);
+  m->bias = instance->wrapper_cc[CC_BIAS] / 127.0;
+  m->tanh_bias = fast_tanh(m->bias);
+  m->dry = pow(instance->wrapper_cc[CC_DRY] / 127.0, 2);
+  m->wet = pow(instance->wrapper_cc[CC_WET] / 127.0, 2);
+
+  smooth_set_cc(&m->smooth, instance->wrapper_cc);
+}
+
+// While a filter knob moves, both filters' coefficients are interpolated
+// across the block to the ones at the block's end.
+void plugin_process(struct instance* instance, int nframes) {
+  struct mjack_biquad *m = instance->plugin;
+  double drive = m->drive;
+  double bias = m->bias;
+  double tanh_bias = m->tanh_bias;
+  double dry = m->dry;
+  double wet = m->wet;
+
+  int moving = smooth_block(&m->smooth, nframes);
+  struct biquad_norm pre = m->pre_coeffs;
+  struct biquad_norm post = m->post_coeffs;
+  if (moving) {
+    set_coeffs(m, m->smooth.value);
+    biquad_norm_process_ramp(&pre, &m->pre_coeffs, &m->pre, m->in, m->out, nframes);
+  } else {
+    biquad_norm_process(&pre, &m->pre, m->in, m->out, nframes);
+  }
 
   FOR(i, nframes) {
     m->out[i] =
       m->out[i] * dry +
-      (tanh(m->out[i] * drive + bias) - tanh_bias) * wet;
+      (fast_tanh(m->out[i] * drive + bias) - tanh_bias) * wet;
   }
 
-  struct biquad_coeffs post_coeffs = biquad_invert(pre_coeffs);
-  biquad_process(post_coeffs, &m->post, m->out, m->out, nframes);
+  if (moving) {
+    biquad_norm_process_ramp(&post, &m->post_coeffs, &m->post, m->out, m->out, nframes);
+  } else {
+    biquad_norm_process(&post, &m->post, m->out, m->out, nframes);
+  }
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct mjack_biquad *m = calloc(1, sizeof(struct mjack_biquad));
   instance->plugin = m;
+  // Three passes over the block: keep it in L1.
+  instance->plugin_block_size = 64;
   init(m, sample_rate);
+  smooth_init(&m->smooth, SMOOTH_LINEAR, SMOOTH_SECONDS, sample_rate);
+  smooth_add_cc(&m->smooth, CC_FREQ);
+  smooth_add_cc(&m->smooth, CC_Q);
+  smooth_add_cc(&m->smooth, CC_LOW_GAIN);
+  smooth_add_cc(&m->smooth, CC_MID_GAIN);
+  smooth_add_cc(&m->smooth, CC_HIGH_GAIN);
   wrapper_add_audio_input(instance, "in", &m->in);
   wrapper_add_audio_output(instance, "out", &m->out);
 #define X(name, value, label) wrapper_add_cc(instance, value, label, #name, 64);
   KNOBS
 #undef X
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
+  smooth_snap(&m->smooth);
+  set_coeffs(m, m->smooth.value);
 }
 
 void plugin_destroy(struct instance* instance) {
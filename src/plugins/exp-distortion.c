@@ -43,6 +43,14 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *h = calloc(1, sizeof(struct filter));
   h->dt = 1.0 / sample_rate;
@@ -4,6 +4,8 @@
 #include <limits.h>
 #include <unistd.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 
 const char* plugin_name = "FM";
 const char* plugin_persistence_name = "mjack_fm";
@@ -117,7 +119,7 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
       FOR(k, 2) {
 	fm_j += mod[j][k] * out[k];
       }
-      out[j] = sin(2*3.141592*(phase[j] - fm_j)) * amp[j];
+      out[j] = fast_sin(2*3.141592*(phase[j] - fm_j)) * amp[j];
     }
     FOR(j, 2) freq[j] *= fmax(0, 1 - freq[j] * dt * freq_decay[j]);
     FOR(j, 2) amp[j] *= fmax(0, 1 - dt * amp_decay[j]);
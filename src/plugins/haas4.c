@@ -53,6 +53,15 @@ void plugin_process(struct instance* instance, int nframes) {
   if (nframes > 0) mix(h, offset, nframes);
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_INPUT("in 1"),
+  PLUGIN_AUDIO_INPUT("in 2"),
+  PLUGIN_AUDIO_INPUT("in 3"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct haas4 *h = calloc(1, sizeof(struct haas4));
   instance->plugin = h;
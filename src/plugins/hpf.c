@@ -50,6 +50,13 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_CC(CC_CUTOFF, "Cutoff"),
+  PLUGIN_CC(CC_ORDER, "Order"),
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct hpf *h = calloc(1, sizeof(struct hpf));
   instance->plugin = h;
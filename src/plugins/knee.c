@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 
 const char* plugin_name = "Knee";
 const char* plugin_persistence_name = "mjack_knee";
@@ -34,12 +36,20 @@ void plugin_process(struct instance* instance, int nframes) {
   double knee = pow((1 + instance->wrapper_cc[CC_KNEE])/128.0, 2);
   double knee_recip = 1.0 / knee;
   if (instance->wrapper_cc[CC_SHAPE] < 64) {
-    FOR(i, nframes) { h->out[i] = tanh(h->in[i] * knee_recip) * knee; }
+    FOR(i, nframes) { h->out[i] = fast_tanh(h->in[i] * knee_recip) * knee; }
   } else {
     FOR(i, nframes) { h->out[i] = shape2(h->in[i] * knee_recip) * knee; }
   }
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *h = calloc(1, sizeof(struct filter));
   instance->plugin = h;
@@ -1,10 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#include "../dsp/smooth.h"
 
 const char* plugin_name = "MonoPanner";
 const char* plugin_persistence_name = "mjack_mono_panner";
@@ -22,6 +25,10 @@ enum {
 };
 
 #define DELAY_BUFFER_LEN 65536
+#define SMOOTH_SECONDS 0.01
+
+// The delay is not smoothed: it jumps by whole frames either way.
+enum { S_SIDE_GAIN, S_SIDE_HP_CUTOFF };
 
 struct filter {
   float *in;
@@ -31,14 +38,32 @@ struct filter {
   double lp;
   float delay_buffer[DELAY_BUFFER_LEN];
   int index;
+  struct smooth smooth;
 };
 
-void plugin_process(struct instance* instance, int nframes) {
+static void cc_changed(struct instance* instance) {
   struct filter *h = instance->plugin;
-  double gain = (instance->wrapper_cc[CC_SIDE_GAIN] - 63.5) / 63.5;
+  smooth_set_cc(&h->smooth, instance->wrapper_cc);
+}
+
+static double side_gain(float cc) {
+  return (cc - 63.5) / 63.5;
+}
+
+static double side_hp_k(struct filter *h, float cc) {
+  double hp_omega = 2 * 3.141592 * 440 * pow(2.0, (cc - 69) / 12.0);
+  return -expm1(-hp_omega * h->dt);
+}
 
-  double hp_omega = 2 * 3.141592 * 440 * pow(2.0, (instance->wrapper_cc[CC_SIDE_HP_CUTOFF] - 69) / 12.0);
-  double hp_k = -expm1(-hp_omega * h->dt);
+void plugin_process(struct instance* instance, int nframes) {
+  struct filter *h = instance->plugin;
+  smooth_block(&h->smooth, nframes);
+  const float *cc0 = h->smooth.start;
+  const float *cc1 = h->smooth.value;
+  double gain = side_gain(cc0[S_SIDE_GAIN]);
+  double gain_step = (side_gain(cc1[S_SIDE_GAIN]) - gain) / nframes;
+  double hp_k = side_hp_k(h, cc0[S_SIDE_HP_CUTOFF]);
+  double hp_k_step = (side_hp_k(h, cc1[S_SIDE_HP_CUTOFF]) - hp_k) / nframes;
   int delay = (int) (0.5 * pow(instance->wrapper_cc[CC_SIDE_DELAY] / 127.0, 2) / h->dt + 0.5);
 
   FOR(i, nframes) {
@@ -49,24 +74,39 @@ void plugin_process(struct instance* instance, int nframes) {
     h->index++;
     h->index &= (DELAY_BUFFER_LEN - 1);
 
-    h->lp += hp_k * (side - h->lp);
+    h->lp += (hp_k + hp_k_step * i) * (side - h->lp);
     side -= h->lp;
-    side *= gain;
+    side *= gain + gain_step * i;
     h->outL[i] = mid + side;
     h->outR[i] = mid - side;
   }
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("left"),
+  PLUGIN_AUDIO_OUTPUT("right"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *h = calloc(1, sizeof(struct filter));
   instance->plugin = h;
   h->dt = 1.0 / sample_rate;
+  smooth_init(&h->smooth, SMOOTH_ONE_POLE, SMOOTH_SECONDS, sample_rate);
+  smooth_add_cc(&h->smooth, CC_SIDE_GAIN);
+  smooth_add_cc(&h->smooth, CC_SIDE_HP_CUTOFF);
   wrapper_add_audio_input(instance, "in", &h->in);
   wrapper_add_audio_output(instance, "left", &h->outL);
   wrapper_add_audio_output(instance, "right", &h->outR);
 #define X(name, value, label) wrapper_add_cc(instance, value, label, #name, 64);
   KNOBS
 #undef X
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
+  smooth_snap(&h->smooth);
 }
 
 void plugin_destroy(struct instance* instance) {
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
 
 // Mono parallel comb reverb designed for natural f^2 mode density.
 //
@@ -44,10 +45,10 @@ enum {
 struct reverb {
   float* inbuf;
   float* outbuf;
-  char cc[128];
   double nframes_per_second;
   int32_t predelay_pos;
   int32_t pos;
+  int32_t drain_len; // frames until the last input has left the predelays and combs
   struct {
     int32_t predelay_len;
     int32_t len; 
@@ -60,15 +61,18 @@ struct reverb {
     float predelay_randoms;
  } delay[NUM_DELAYS];
   float predelay_buf[MAX_PREDELAY] __attribute__((aligned(16)));
+  struct arena arena;
 }  __attribute__((aligned(16)));
 
-static void recompute(struct reverb *r) {
-  float rt = 1.5 * pow(10.0, r->cc[CC_RT]/64.0 - 1.0);
-  float base_freq = 20 * pow(10.0, r->cc[CC_F0]/64.0 - 1.0);
-  float delta_freq = 4 * pow(10.0, r->cc[CC_FD]/64.0 - 1.0);
-  float base_predelay = 0.05 * pow(10.0, r->cc[CC_P0]/64.0 - 1.0);
-  float delta_predelay = 0.01 * pow(10.0, r->cc[CC_PD]/64.0 - 1.0);
-  float sqrt_damping = 100.0 * pow(r->cc[CC_DAMPING]/127.0, 4.0);
+static void cc_changed(struct instance* instance) {
+  struct reverb *r = instance->plugin;
+  const char *cc = instance->wrapper_cc;
+  float rt = 1.5 * pow(10.0, cc[CC_RT]/64.0 - 1.0);
+  float base_freq = 20 * pow(10.0, cc[CC_F0]/64.0 - 1.0);
+  float delta_freq = 4 * pow(10.0, cc[CC_FD]/64.0 - 1.0);
+  float base_predelay = 0.05 * pow(10.0, cc[CC_P0]/64.0 - 1.0);
+  float delta_predelay = 0.01 * pow(10.0, cc[CC_PD]/64.0 - 1.0);
+  float sqrt_damping = 100.0 * pow(cc[CC_DAMPING]/127.0, 4.0);
   FOR(i, NUM_DELAYS) {
     float freq = base_freq + delta_freq * ((NUM_DELAYS - 1 - i) + r->delay[i].freq_randoms);
     float predelay = base_predelay + delta_predelay * (i + r->delay[i].predelay_randoms);
@@ -83,6 +87,11 @@ static void recompute(struct reverb *r) {
     r->delay[i].lpcoeff_mirror = 1 - lpcoeff;
     r->delay[i].predelay_len = r->nframes_per_second * predelay;
   }
+  r->drain_len = 0;
+  FOR(i, NUM_DELAYS) {
+    int32_t len = r->delay[i].predelay_len + r->delay[i].len;
+    if (len > r->drain_len) r->drain_len = len;
+  }
 }
 
 static void init(struct reverb* r, double nframes_per_second) {
@@ -91,7 +100,6 @@ static void init(struct reverb* r, double nframes_per_second) {
     r->delay[i].predelay_randoms = rand() / (RAND_MAX + 1.0);
   }
   r->nframes_per_second = nframes_per_second;
-  recompute(r);
 }
 
 static inline void minf(int *x, int y) {
@@ -102,14 +110,6 @@ static inline void minf(int *x, int y) {
 
 void plugin_process(struct instance *instance, int nframes) {
   struct reverb *r = instance->plugin;
-  FOR(i, 128) {
-    if (r->cc[i] != instance->wrapper_cc[i]) {
-      FOR(j, 128) { r->cc[j] = instance->wrapper_cc[j]; }
-      recompute(r);
-      break;
-    }
-  }
-
   // TODO break computation up into blocks of known max size to not
   // overflow predelay buffer
 
@@ -121,10 +121,15 @@ void plugin_process(struct instance *instance, int nframes) {
     predelay_buf[(pos + i) & PREDELAY_MASK] = inbuf[i];
   }
 
-  // Clear output
+  // Clear output, unless the wrapper wants us to add to it
   float *outbuf = r->outbuf;
-  FOR(i, nframes) {
-    outbuf[i] = 0;
+  float out_gain = 1.0f;
+  if (instance->wrapper_run_adding) {
+    out_gain = instance->wrapper_run_adding_gain;
+  } else {
+    FOR(i, nframes) {
+      outbuf[i] = 0;
+    }
   }
 
   // Add delays
@@ -151,7 +156,7 @@ void plugin_process(struct instance *instance, int nframes) {
       for(int k = 0; k < n; k++) {
 	lpstate = lpstate * lpcoeff_mirror + pfb[k] * fbgain_lpcoeff;
 	pfi[k] = lpstate + pin[k] * ingain;
-	pout[k] += lpstate;
+	pout[k] += lpstate * out_gain;
       }
       i += n;
     }
@@ -160,19 +165,46 @@ void plugin_process(struct instance *instance, int nframes) {
   r->pos = pos + nframes;
 }
 
+static float tail(struct instance* instance, int nframes) {
+  struct reverb *r = instance->plugin;
+  if (instance->wrapper_silent_frames < r->drain_len) return 1;
+  // The combs are summed, so their states bound the output.
+  float sum = 0;
+  FOR(i, NUM_DELAYS) sum += fabsf(r->delay[i].lpstate);
+  return sum;
+}
+
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
-  struct reverb* r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  // About 8 MB of delay lines: large enough for huge pages.
+  struct arena arena;
+  arena_init(&arena, arena_size(sizeof(struct reverb)));
+  struct reverb* r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_can_run_adding = 1;
+  // Every delay makes a pass over the output block.
+  instance->plugin_block_size = 256;
+  instance->plugin_tail = tail;
   wrapper_add_audio_input(instance, "in", &r->inbuf);
   wrapper_add_audio_output(instance, "out", &r->outbuf);
 #define X(name, value, label) wrapper_add_cc(instance, value, label, #name, 64);
   KNOBS
 #undef X
   init(r, sample_rate);
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
 }
 
 void plugin_destroy(struct instance* instance) {
-  free(instance->plugin);
+  struct reverb* r = instance->plugin;
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
@@ -4,6 +4,8 @@
 #include <unistd.h>
 
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 #include "../dsp/osc.h"
 
 const char* plugin_name = "MonoSynth";
@@ -118,7 +120,7 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
 
       fb -= (fb_pole += (fb - fb_pole) * kfb);
 
-      tmp -= reso * tanh(fb*6);
+      tmp -= reso * fast_tanh(fb*6);
       FOR(j, 4) {
 	tmp = (pole[j] += (tmp - pole[j]) * kc);
       }
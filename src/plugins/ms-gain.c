@@ -1,10 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#include "../dsp/smooth.h"
 
 const char* plugin_name = "Mid-Side Gain";
 const char* plugin_persistence_name = "mjack_ms_gain";
@@ -13,32 +16,62 @@ const unsigned plugin_ladspa_unique_id = 11;
 #define CC_MID_GAIN 80
 #define CC_SIDE_GAIN 81
 
+#define SMOOTH_SECONDS 0.02
+
+enum { S_MID_GAIN, S_SIDE_GAIN };
+
 struct ms_gain {
   float *in[2];
   float *out[2];
+  struct smooth smooth;
 };
 
+static void cc_changed(struct instance* instance) {
+  struct ms_gain *p = instance->plugin;
+  smooth_set_cc(&p->smooth, instance->wrapper_cc);
+}
+
 void plugin_process(struct instance* instance, int nframes) {
   struct ms_gain *p = instance->plugin;
-  float mid_gain = powf(instance->wrapper_cc[CC_MID_GAIN]/64.0f, 2.0f);
-  float side_gain = powf(instance->wrapper_cc[CC_SIDE_GAIN]/64.0f, 2.0f);
+  smooth_block(&p->smooth, nframes);
+  const float *cc0 = p->smooth.start;
+  const float *cc1 = p->smooth.value;
+  float mid_gain = powf(cc0[S_MID_GAIN]/64.0f, 2.0f);
+  float side_gain = powf(cc0[S_SIDE_GAIN]/64.0f, 2.0f);
+  float mid_step = (powf(cc1[S_MID_GAIN]/64.0f, 2.0f) - mid_gain) / nframes;
+  float side_step = (powf(cc1[S_SIDE_GAIN]/64.0f, 2.0f) - side_gain) / nframes;
   FOR(i, nframes) {
-    float mid = (p->in[0][i] + p->in[1][i]) * (0.5f * mid_gain);
-    float side = (p->in[0][i] - p->in[1][i]) * (0.5f * side_gain);
+    float mid = (p->in[0][i] + p->in[1][i]) * (0.5f * (mid_gain + mid_step * i));
+    float side = (p->in[0][i] - p->in[1][i]) * (0.5f * (side_gain + side_step * i));
     p->out[0][i] = mid + side;
     p->out[1][i] = mid - side;
   }
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_CC(CC_MID_GAIN, "Mid Gain"),
+  PLUGIN_CC(CC_SIDE_GAIN, "Side Gain"),
+  PLUGIN_AUDIO_INPUT("in left"),
+  PLUGIN_AUDIO_INPUT("in right"),
+  PLUGIN_AUDIO_OUTPUT("out left"),
+  PLUGIN_AUDIO_OUTPUT("out right"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct ms_gain *h = calloc(1, sizeof(struct ms_gain));
   instance->plugin = h;
+  smooth_init(&h->smooth, SMOOTH_LINEAR, SMOOTH_SECONDS, sample_rate);
+  smooth_add_cc(&h->smooth, CC_MID_GAIN);
+  smooth_add_cc(&h->smooth, CC_SIDE_GAIN);
   wrapper_add_cc(instance, CC_MID_GAIN, "Mid Gain", "mid_gain", 64);
   wrapper_add_cc(instance, CC_SIDE_GAIN, "Side Gain", "side_gain", 64);
   wrapper_add_audio_input(instance, "in left", &h->in[0]);
   wrapper_add_audio_input(instance, "in right", &h->in[1]);
   wrapper_add_audio_output(instance, "out left", &h->out[0]);
   wrapper_add_audio_output(instance, "out right", &h->out[1]);
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
+  smooth_snap(&h->smooth);
 }
 
 void plugin_destroy(struct instance* instance) {
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
 
 const char* plugin_name = "Mid-Side Reverb";
 const char* plugin_persistence_name = "mjack_ms_reverb";
@@ -34,6 +35,7 @@ struct reverb {
   float* tank_buf;
   int tank_len;
   int base;
+  struct arena arena;
 };
 
 static double frand(void) {
@@ -54,10 +56,14 @@ static void init_buf_offs(struct reverb* r) {
   }
 }
 
+static int tank_len(double nframes_per_second) {
+  return (int)(nframes_per_second * 1.0);
+}
+
 static void init(struct reverb* r, double nframes_per_second) {
   r->dt = 1.0 / nframes_per_second;
-  r->tank_len = (int)(nframes_per_second * 1.0);
-  r->tank_buf = calloc(r->tank_len, sizeof(float)); // TODO don't leak
+  r->tank_len = tank_len(nframes_per_second);
+  r->tank_buf = arena_alloc(&r->arena, r->tank_len * sizeof(float));
   init_buf_offs(r);
 }
 
@@ -148,6 +154,8 @@ void plugin_process(struct instance* instance, int nframes) {
   double feedback_gain = -square(instance->wrapper_cc[CC_FEEDBACK] / 127.0);
   double decay_gain = instance->wrapper_cc[CC_DECAY] / 127.0;
   int stage = instance->wrapper_cc[CC_STAGES] * (NUM_STAGES / 2) / 128;
+  int adding = instance->wrapper_run_adding;
+  if (adding) reverb_gain *= instance->wrapper_run_adding_gain;
   int io_base = 0;
   while (nframes > 0) {
     int n = nframes;
@@ -176,8 +184,13 @@ void plugin_process(struct instance* instance, int nframes) {
 	r->buf[NUM_STAGES/2*o][0][i] *= feedback_gain;
 	r->buf[NUM_STAGES/2*o][0][i] += r->inbufs[0][io_base + i];
       }
-      r->outbufs[0][io_base + i] = left;
-      r->outbufs[1][io_base + i] = right;
+      if (adding) {
+	r->outbufs[0][io_base + i] += left;
+	r->outbufs[1][io_base + i] += right;
+      } else {
+	r->outbufs[0][io_base + i] = left;
+	r->outbufs[1][io_base + i] = right;
+      }
     }
     if (MIX_SIZE == 4) FOR(s, NUM_STAGES) mix4(r, s, n, 1 + decay_gain);
     if (MIX_SIZE == 8) FOR(s, NUM_STAGES) mix8(r, s, n, 1 + decay_gain);
@@ -203,11 +216,24 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+  PLUGIN_CC(CC_WET_LEVEL, "Wet"),
+  PLUGIN_CC(CC_FEEDBACK, "Feedback"),
+  PLUGIN_CC(CC_DECAY, "Decay"),
+  PLUGIN_CC(CC_STAGES, "Stages"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   printf("plugin_init\n");
-  struct reverb* r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  struct arena arena;
+  arena_init(&arena, arena_size(sizeof(struct reverb)) + arena_size(tank_len(sample_rate) * sizeof(float)));
+  struct reverb* r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_can_run_adding = 1;
   printf("init\n");
   init(r, sample_rate);
 #define MAX_NAME_LENGTH 16
@@ -228,8 +254,6 @@ void plugin_init(struct instance* instance, double sample_rate) {
 
 void plugin_destroy(struct instance* instance) {
   struct reverb* r = instance->plugin;
-  free(r->tank_buf);
-  r->tank_buf = NULL;
-  free(instance->plugin);
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
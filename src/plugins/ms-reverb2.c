@@ -6,6 +6,7 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
 
 const char* plugin_name = "Mid-Side Reverb 2";
 const char* plugin_persistence_name = "mjack_ms_reverb2";
@@ -14,6 +15,7 @@ const unsigned plugin_ladspa_unique_id = 12;
 #define NUM_INS 1
 #define NUM_OUTS 2
 #define NUM_STAGES 8
+#define WORK_LEN 256
 
 #define CC_K 80
 
@@ -25,46 +27,49 @@ struct reverb {
   int allpass_pos[NUM_OUTS][NUM_STAGES];
   float allpass_time[NUM_OUTS][NUM_STAGES];
   double sr;
+  float work[NUM_OUTS][WORK_LEN];
+  struct arena arena;
 };
 
-static void init(struct reverb* r, double nframes_per_second) {
-  static double time[NUM_OUTS][NUM_STAGES] = {
-    { 0.0112998, 0.02892348, 0.03295123, 0.0485128, 0.051856, 0.0669123, 0.0712357, 0.0881253 },
-    { 0.0138915, 0.02123515, 0.03961282, 0.0451823, 0.055823, 0.0631522, 0.0752381, 0.0871258 },
-  };
-  FOR(o, NUM_OUTS) {
-    FOR(s, NUM_STAGES) {
-      r->allpass_time[o][s] = time[o][s];
-      r->allpass_len[o][s] = (int) (r->allpass_time[o][s] * nframes_per_second + 0.5);
-      r->allpass_buf[o][s] = calloc(1, sizeof(float) * r->allpass_len[o][s]); // TODO contiguous alloc
-    }
-  }
+static const double default_allpass_time[NUM_OUTS][NUM_STAGES] = {
+  { 0.0112998, 0.02892348, 0.03295123, 0.0485128, 0.051856, 0.0669123, 0.0712357, 0.0881253 },
+  { 0.0138915, 0.02123515, 0.03961282, 0.0451823, 0.055823, 0.0631522, 0.0752381, 0.0871258 },
+};
+
+static int allpass_len(int o, int s, double nframes_per_second) {
+  return (int) (default_allpass_time[o][s] * nframes_per_second + 0.5);
 }
 
-static void destroy(struct reverb* r) {
+static size_t arena_bytes(double nframes_per_second) {
+  size_t size = arena_size(sizeof(struct reverb));
+  FOR(o, NUM_OUTS) FOR(s, NUM_STAGES) size += arena_size(sizeof(float) * allpass_len(o, s, nframes_per_second));
+  return size;
+}
+
+static void init(struct reverb* r, double nframes_per_second) {
   FOR(o, NUM_OUTS) {
     FOR(s, NUM_STAGES) {
-      free(r->allpass_buf[o][s]);
-      r->allpass_buf[o][s] = NULL;
+      r->allpass_time[o][s] = default_allpass_time[o][s];
+      r->allpass_len[o][s] = allpass_len(o, s, nframes_per_second);
+      r->allpass_buf[o][s] = arena_alloc(&r->arena, sizeof(float) * r->allpass_len[o][s]);
     }
   }
 }
 
-void plugin_process(struct instance* instance, int nframes) {
+// Up to WORK_LEN frames, through r->work so that the outputs can be added to
+static void process_block(struct instance* instance, int io_base, int nframes) {
   struct reverb* r = instance->plugin;
 
-  const float *in = r->inbufs[0];
+  const float *in = r->inbufs[0] + io_base;
   FOR(o, NUM_OUTS) {
-    float *out = r->outbufs[o];
-    if (in != out) {
-      FOR(i, nframes) {
-	out[i] = in[i];
-      }
+    float *out = r->work[o];
+    FOR(i, nframes) {
+      out[i] = in[i];
     }
   }
   float kshape = instance->wrapper_cc[CC_K] / 128.0;
   FOR(o, NUM_OUTS) {
-    float *out = r->outbufs[o];
+    float *out = r->work[o];
     FOR(i, NUM_STAGES) {
       float *buf = r->allpass_buf[o][i];
       int len = r->allpass_len[o][i];
@@ -86,19 +91,47 @@ void plugin_process(struct instance* instance, int nframes) {
       r->allpass_pos[o][i] = pos;
     }
   }
-  FOR(i, nframes) {
-    double a = r->outbufs[0][i];
-    double b = r->outbufs[1][i];
-    r->outbufs[0][i] = 0.5 * (a + b);
-    r->outbufs[1][i] = 0.5 * (a - b);
+  float *left = r->outbufs[0] + io_base;
+  float *right = r->outbufs[1] + io_base;
+  if (instance->wrapper_run_adding) {
+    double g = 0.5 * instance->wrapper_run_adding_gain;
+    FOR(i, nframes) {
+      double a = r->work[0][i];
+      double b = r->work[1][i];
+      left[i] += g * (a + b);
+      right[i] += g * (a - b);
+    }
+  } else {
+    FOR(i, nframes) {
+      double a = r->work[0][i];
+      double b = r->work[1][i];
+      left[i] = 0.5 * (a + b);
+      right[i] = 0.5 * (a - b);
+    }
   }
 }
 
+void plugin_process(struct instance* instance, int nframes) {
+  for (int io_base = 0; io_base < nframes; io_base += WORK_LEN) {
+    process_block(instance, io_base, nframes - io_base < WORK_LEN ? nframes - io_base : WORK_LEN);
+  }
+}
+
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+  PLUGIN_CC(CC_K, "K"),
+)
+
 void plugin_init(struct instance* instance, double sample_rate) {
   printf("plugin_init\n");
-  struct reverb* r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  struct arena arena;
+  arena_init(&arena, arena_bytes(sample_rate));
+  struct reverb* r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_can_run_adding = 1;
   printf("init\n");
   init(r, sample_rate);
 #define MAX_NAME_LENGTH 16
@@ -116,7 +149,6 @@ void plugin_init(struct instance* instance, double sample_rate) {
 
 void plugin_destroy(struct instance* instance) {
   struct reverb* r = instance->plugin;
-  destroy(r);
-  free(instance->plugin);
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
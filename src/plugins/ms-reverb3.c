@@ -6,6 +6,8 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
+#include "../wrappers/tail.h"
 
 const char* plugin_name = "Mid-Side Reverb 3";
 const char* plugin_persistence_name = "mjack_ms_reverb3";
@@ -14,6 +16,7 @@ const unsigned plugin_ladspa_unique_id = 13;
 #define NUM_INS 1
 #define NUM_OUTS 2
 #define NUM_STAGES 8
+#define WORK_LEN 256
 
 #define CC_SHAPE 80
 #define CC_SIGN 81
@@ -25,10 +28,16 @@ struct reverb {
   float* inbufs[NUM_INS];
   float* outbufs[NUM_OUTS];
   int allpasspos[NUM_OUTS][NUM_STAGES];
+  float *allpassbuf[NUM_OUTS][NUM_STAGES];
+  int allpasslen[NUM_OUTS][NUM_STAGES];
+  float k[NUM_OUTS][NUM_STAGES];
   float nframes_per_second;
   float *memory_pool_start;
   float *memory_pool_end;
   double sr;
+  float work[NUM_OUTS][WORK_LEN];
+  struct tail_scan tail_scan;
+  struct arena arena;
 };
 
 static int gcd(int a, int b) {
@@ -36,20 +45,19 @@ static int gcd(int a, int b) {
   else return gcd(b, a % b);
 }
 
+static int memory_pool_len(double nframes_per_second) {
+  return (int) (nframes_per_second * NUM_OUTS * NUM_STAGES * MAX_STAGE_TIME_SECONDS * 1.1);
+}
+
 static void init(struct reverb* r, double nframes_per_second) {
   r->nframes_per_second = nframes_per_second;
-  int n = (int) (nframes_per_second * NUM_OUTS * NUM_STAGES * MAX_STAGE_TIME_SECONDS * 1.1);
-  r->memory_pool_start = calloc(1, sizeof(float) * n);
+  int n = memory_pool_len(nframes_per_second);
+  r->memory_pool_start = arena_alloc(&r->arena, sizeof(float) * n);
   r->memory_pool_end = r->memory_pool_start + n;
+  tail_scan_init(&r->tail_scan);
 }
 
-static void destroy(struct reverb* r) {
-  free(r->memory_pool_start);
-  r->memory_pool_start = NULL;
-  r->memory_pool_end = NULL;
-}
-
-void plugin_process(struct instance* instance, int nframes) {
+static void cc_changed(struct instance* instance) {
   struct reverb* r = instance->plugin;
   float allpasstime[NUM_OUTS][NUM_STAGES];
   FOR(o, NUM_OUTS) {
@@ -57,35 +65,24 @@ void plugin_process(struct instance* instance, int nframes) {
       allpasstime[o][s] = MAX_STAGE_TIME_SECONDS * (instance->wrapper_cc[CC_ALLPASS_TIME_START + o * NUM_STAGES + s] + 1) / 128.0;
     }
   }
-  float *allpassbuf[NUM_OUTS][NUM_STAGES];
-  int allpasslen[NUM_OUTS][NUM_STAGES];
   float *alloc_ptr = r->memory_pool_start;
   FOR(o, NUM_OUTS) {
     FOR(s, NUM_STAGES) {
       int len = (int) (allpasstime[o][s] * r->nframes_per_second + 0.5f);
     try_again:
       FOR(t, s) {
-	if (gcd(len, allpasslen[o][t]) != 1) {
+	if (gcd(len, r->allpasslen[o][t]) != 1) {
 	  len++;
 	  goto try_again;
 	}
       }
       //printf("%i %i %f %i\n", o, s, allpasstime[o][s], len);
-      allpasslen[o][s] = len;
-      allpassbuf[o][s] = alloc_ptr;
+      r->allpasslen[o][s] = len;
+      r->allpassbuf[o][s] = alloc_ptr;
       alloc_ptr += len;
     }
   }
 
-  const float *in = r->inbufs[0];
-  FOR(o, NUM_OUTS) {
-    float *out = r->outbufs[o];
-    if (in != out) {
-      FOR(i, nframes) {
-	out[i] = in[i];
-      }
-    }
-  }
   if (alloc_ptr >= r->memory_pool_end) {
     //printf("%i\n", (int) (r->memory_pool_end - r->memory_pool_start));
     printf("error: alloc_ptr >= r->memory_pool_end");
@@ -93,12 +90,7 @@ void plugin_process(struct instance* instance, int nframes) {
   float sign = instance->wrapper_cc[CC_SHAPE] >= 64 ? -1 : 1;
   float kshape = (0.5f + instance->wrapper_cc[CC_SHAPE]) / 128.0f;
   FOR(o, NUM_OUTS) {
-    float *out = r->outbufs[o];
     FOR(i, NUM_STAGES) {
-      float *buf = allpassbuf[o][i];
-      int len = allpasslen[o][i];
-      int pos = r->allpasspos[o][i];
-
       // same tail decay rate:
       // tail coloration: strong
       // good for reverse reverb?
@@ -109,7 +101,7 @@ void plugin_process(struct instance* instance, int nframes) {
       //float k = kshape;
 
       // constant tail bandwidth
-      float k = sign * fmax(0.0f, 1.0f - kshape * kshape / allpasstime[o][i]);
+      r->k[o][i] = sign * fmax(0.0f, 1.0f - kshape * kshape / allpasstime[o][i]);
 
       // same power from all tails
       // tail coloration: weak
@@ -121,8 +113,28 @@ void plugin_process(struct instance* instance, int nframes) {
       //float tanw = kshape * kshape / allpasstime[o][i]; // linear approx
       //float k = fmaxf(0.0f, (1 - tanw) / (1 + tanw));
 
-      //printf("%i %i %f\n", o, i, k);
+      //printf("%i %i %f\n", o, i, r->k[o][i]);
+    }
+  }
+}
 
+static void process_block(struct instance* instance, int io_base, int nframes) {
+  struct reverb* r = instance->plugin;
+
+  const float *in = r->inbufs[0] + io_base;
+  FOR(o, NUM_OUTS) {
+    float *out = r->work[o];
+    FOR(i, nframes) {
+      out[i] = in[i];
+    }
+  }
+  FOR(o, NUM_OUTS) {
+    float *out = r->work[o];
+    FOR(i, NUM_STAGES) {
+      float *buf = r->allpassbuf[o][i];
+      int len = r->allpasslen[o][i];
+      int pos = r->allpasspos[o][i];
+      float k = r->k[o][i];
       FOR(j, nframes) {
 	float a = out[j];
 	float b = buf[pos];
@@ -136,19 +148,66 @@ void plugin_process(struct instance* instance, int nframes) {
       r->allpasspos[o][i] = pos;
     }
   }
-  FOR(i, nframes) {
-    double a = r->outbufs[0][i];
-    double b = r->outbufs[1][i];
-    r->outbufs[0][i] = 0.5 * (a + b);
-    r->outbufs[1][i] = 0.5 * (a - b);
+  float *left = r->outbufs[0] + io_base;
+  float *right = r->outbufs[1] + io_base;
+  if (instance->wrapper_run_adding) {
+    double g = 0.5 * instance->wrapper_run_adding_gain;
+    FOR(i, nframes) {
+      double a = r->work[0][i];
+      double b = r->work[1][i];
+      left[i] += g * (a + b);
+      right[i] += g * (a - b);
+    }
+  } else {
+    FOR(i, nframes) {
+      double a = r->work[0][i];
+      double b = r->work[1][i];
+      left[i] = 0.5 * (a + b);
+      right[i] = 0.5 * (a - b);
+    }
+  }
+}
+
+void plugin_process(struct instance* instance, int nframes) {
+  for (int io_base = 0; io_base < nframes; io_base += WORK_LEN) {
+    process_block(instance, io_base, nframes - io_base < WORK_LEN ? nframes - io_base : WORK_LEN);
   }
 }
 
+#define ALLPASS_TIME_CCS(o, label)					\
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 0, label " time 0"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 1, label " time 1"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 2, label " time 2"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 3, label " time 3"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 4, label " time 4"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 5, label " time 5"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 6, label " time 6"), \
+  PLUGIN_CC(CC_ALLPASS_TIME_START + o * NUM_STAGES + 7, label " time 7")
+
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+  PLUGIN_CC(CC_SHAPE, "K"),
+  PLUGIN_CC(CC_SIGN, "Sign"),
+  ALLPASS_TIME_CCS(0, "mid"),
+  ALLPASS_TIME_CCS(1, "side"),
+)
+
+static float tail(struct instance* instance, int nframes) {
+  struct reverb* r = instance->plugin;
+  return tail_scan(&r->tail_scan, instance, r->memory_pool_start, r->memory_pool_end - r->memory_pool_start, nframes);
+}
+
 void plugin_init(struct instance* instance, double sample_rate) {
   printf("plugin_init\n");
-  struct reverb* r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  struct arena arena;
+  arena_init(&arena, arena_size(sizeof(struct reverb)) + arena_size(sizeof(float) * memory_pool_len(sample_rate)));
+  struct reverb* r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_can_run_adding = 1;
+  instance->plugin_tail = tail;
   printf("init\n");
   init(r, sample_rate);
 #define MAX_NAME_LENGTH 16
@@ -166,12 +225,13 @@ void plugin_init(struct instance* instance, double sample_rate) {
   static char allpasstimename[NUM_OUTS][NUM_STAGES][MAX_NAME_LENGTH];
   FOR(o, NUM_OUTS) FOR(s, NUM_STAGES) snprintf(allpasstimename[o][s], MAX_NAME_LENGTH, "%s time %i", outputname[o], s);
   FOR(o, NUM_OUTS) FOR(s, NUM_STAGES) wrapper_add_cc(instance, CC_ALLPASS_TIME_START + o * NUM_STAGES + s, allpasstimename[o][s], allpasstimename[o][s], 64);
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
   printf("exit plugin_init\n");
 }
 
 void plugin_destroy(struct instance* instance) {
   struct reverb* r = instance->plugin;
-  destroy(r);
-  free(instance->plugin);
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
@@ -1,10 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#include "../dsp/biquad.h"
+#include "../dsp/smooth.h"
 
 const char* plugin_name = "Parametric";
 const char* plugin_persistence_name = "mjack_parametric";
@@ -21,66 +25,100 @@ enum {
 #undef X
 };
 
+#define SMOOTH_SECONDS 0.03
+
+enum { S_FREQ, S_Q, S_GAIN };
+
 struct filter {
   float *in;
   float *out;
 
-  double x1, x2;
-  double y1, y2;
-
   double dt;
+
+  struct biquad_norm c; // at the end of the last block
+  struct biquad_state state;
+
+  struct smooth smooth;
 };
 
 static void init(struct filter* h, double sample_rate) {
-  h->x1 = 0;
-  h->x2 = 0;
-  h->y1 = 0;
-  h->y2 = 0;
+  h->state = (struct biquad_state) { 0 };
   h->dt = 1 / sample_rate;
 }
 
-void plugin_process(struct instance* instance, int nframes) {
-  struct filter *h = instance->plugin;
-  double w0 = 2 * 3.141592 * 440 * pow(2.0, (instance->wrapper_cc[CC_FREQ] - 69) / 12.0) * h->dt;
-  double Q = (1 + instance->wrapper_cc[CC_Q]) * 8 / 128.0;
+static void set_coeffs(struct filter *h, const float *cc) {
+  double w0 = 2 * 3.141592 * 440 * pow(2.0, (cc[S_FREQ] - 69) / 12.0) * h->dt;
+  double Q = (1 + cc[S_Q]) * 8 / 128.0;
 
-  double sqrt_gain = (1 + instance->wrapper_cc[CC_GAIN]) * 2 / 128.0;
+  double sqrt_gain = (1 + cc[S_GAIN]) * 2 / 128.0;
 
   double A = sqrt_gain;
 
   double alpha = sin(w0)/(2*Q);
 
-  double b0 =  1 + alpha*A;
-  double b1 = -2*cos(w0);
-  double b2 =  1 - alpha*A;
-  double a0 =  1 + alpha/A;
-  double a1 = -2*cos(w0);
-  double a2 =  1 - alpha/A;
-
-  FOR(i, nframes) {
-    double x0 = h->in[i];
-    double y0 =
-      (1 / a0)
-      * (+ b0 * x0
-	 + b1 * h->x1
-	 + b2 * h->x2
-	 - a1 * h->y1
-	 - a2 * h->y2);
-    h->out[i] = y0;
-    h->x2 = h->x1; h->x1 = x0;
-    h->y2 = h->y1; h->y1 = y0;
+  h->c = biquad_normalize((struct biquad_coeffs) {
+      .b0 =  1 + alpha*A,
+      .b1 = -2*cos(w0),
+      .b2 =  1 - alpha*A,
+      .a0 =  1 + alpha/A,
+      .a1 = -2*cos(w0),
+      .a2 =  1 - alpha/A,
+    });
+}
+
+static void cc_changed(struct instance* instance) {
+  struct filter *h = instance->plugin;
+  smooth_set_cc(&h->smooth, instance->wrapper_cc);
+}
+
+// While a knob moves, the coefficients are interpolated across the block
+// from where the last block left them to the ones at the block's end.
+static void process_moving(struct filter *h, int nframes) {
+  struct biquad_norm c = h->c;
+  set_coeffs(h, h->smooth.value);
+  biquad_norm_process_ramp(&c, &h->c, &h->state, h->in, h->out, nframes);
+}
+
+void plugin_process(struct instance* instance, int nframes) {
+  struct filter *h = instance->plugin;
+  if (smooth_block(&h->smooth, nframes)) {
+    process_moving(h, nframes);
+    return;
   }
+  biquad_norm_process(&h->c, &h->state, h->in, h->out, nframes);
 }
 
+static float tail(struct instance* instance, int nframes) {
+  struct filter *h = instance->plugin;
+  return fmax(fabs(h->state.s1), fabs(h->state.s2));
+}
+
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *h = calloc(1, sizeof(struct filter));
   instance->plugin = h;
+  instance->plugin_tail = tail;
   init(h, sample_rate);
+  smooth_init(&h->smooth, SMOOTH_LINEAR, SMOOTH_SECONDS, sample_rate);
+  smooth_add_cc(&h->smooth, CC_FREQ);
+  smooth_add_cc(&h->smooth, CC_Q);
+  smooth_add_cc(&h->smooth, CC_GAIN);
   wrapper_add_audio_input(instance, "in", &h->in);
   wrapper_add_audio_output(instance, "out", &h->out);
 #define X(name, value, label) wrapper_add_cc(instance, value, label, #name, 64);
   KNOBS
 #undef X
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
+  smooth_snap(&h->smooth);
+  set_coeffs(h, h->smooth.value);
 }
 
 void plugin_destroy(struct instance* instance) {
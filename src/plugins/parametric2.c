@@ -61,6 +61,14 @@ void plugin_process(struct instance* instance, int nframes) {
   biquad_process(coeffs, &m->biquad_state, m->in, m->out, nframes);
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct mjack_biquad *m = calloc(1, sizeof(struct mjack_biquad));
   instance->plugin = m;
@@ -11,6 +11,8 @@
 
 #include "../wrappers/wrapper.h"
 #include "../dsp/osc.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 #include "../dsp/svf.h"
 #include "../dsp/ladder.h"
 #include "../dsp/ms20-filter.h"
@@ -22,6 +24,7 @@ const char* plugin_name = "PolySaw";
 const char* plugin_persistence_name = "mjack_polysaw";
 
 #define NUM_VOICES 8
+#define BLOCK_SIZE 64
 
 #define FOR(var,limit) for(int var = 0; var < limit; ++var)
 
@@ -70,6 +73,22 @@ static double dt;
 #define CC_PW 108
 #define CC_PW_LFO 109
 
+// dsp parameters, recomputed by cc_changed
+static struct {
+  double vcf_pregain;
+  double reso_1;
+  double vcf1_clip_level;
+  double volume;
+  double drift;
+  double lfo_delay;
+  double lfo_freq;
+  double osc_lfo;
+  double pw;
+  double pw_lfo;
+  double vcf1_tracking;
+  double vcf1_cutoff;
+} params;
+
 // dsp control values
 static double gain[NUM_VOICES];
 static double osc_freq[NUM_VOICES];
@@ -83,15 +102,22 @@ static struct ladder ladder[NUM_VOICES];
 //static struct ms20_filter ms20_filter_1[NUM_VOICES];
 //static struct ms20_filter ms20_filter_2[NUM_VOICES];
 
-static struct adsr_env vca_env[NUM_VOICES];
-static struct adsr_env vcf1_env[NUM_VOICES];
-static struct adsr_env vcf2_env[NUM_VOICES];
+static struct adsr_env vca_env;
+static struct adsr_env vcf1_env;
+static struct adsr_env vcf2_env;
+
+// envelopes of the current block, [frame][voice]
+static double vca_env_out[BLOCK_SIZE][ADSR_ENV_MAX_VOICES];
+static double vcf1_env_out[BLOCK_SIZE][ADSR_ENV_MAX_VOICES];
 
-struct lfo lfo[NUM_VOICES];
+static struct lfo lfo[NUM_VOICES];
 
 static void init(double sample_rate) {
   dt = 1.0 / sample_rate;
   printf("dt = %lg\n", dt);
+  adsr_env_init(&vca_env, NUM_VOICES, dt, 0);
+  adsr_env_init(&vcf1_env, NUM_VOICES, dt, 2);
+  adsr_env_init(&vcf2_env, NUM_VOICES, dt, 2);
 }
 static void handle_midi_note_off(int key, int velocity) {
   if (key_is_pressed[key]) {
@@ -99,6 +125,9 @@ static void handle_midi_note_off(int key, int velocity) {
     FOR(v, NUM_VOICES) {
       if (current_key[v] == key) {
 	gain[v] = 0.0;
+	adsr_env_release(&vca_env, v);
+	adsr_env_release(&vcf1_env, v);
+	adsr_env_release(&vcf2_env, v);
       }
     }
   }
@@ -116,9 +145,9 @@ static void handle_midi_note_on(struct instance* instance, int key, int velocity
 
 	osc_freq[v] = instance->freq[key];
 	env_freq[v] = osc_freq[v] * 1.0;
-	adsr_env_trigger(&vca_env[v]);
-	adsr_env_trigger(&vcf1_env[v]);
-	adsr_env_trigger(&vcf2_env[v]);
+	adsr_env_trigger(&vca_env, v);
+	adsr_env_trigger(&vcf1_env, v);
+	adsr_env_trigger(&vcf2_env, v);
 	lfo_trigger(&lfo[v]);
 	gain[v] = velocity / 127.0;
 	return;
@@ -139,66 +168,85 @@ static void handle_midi_event(struct instance* instance, const struct midi_event
       handle_midi_note_on(instance, event->buffer[1], event->buffer[2]);
     }
     break;
-  case 0xB0:
-    fprintf(stderr, "Received CC %i -> %i\n", event->buffer[1], event->buffer[2]);
-    instance->wrapper_cc[event->buffer[1]] = event->buffer[2];
-    break;
   }
 }
 
-static void generate_audio(struct instance* instance, int start_frame, int end_frame) {
-  for(int i = start_frame; i < end_frame; ++i) {
-    audio_out_buf[i] = 0.0;
-  }
-  double vca_attack  = pow(instance->wrapper_cc[CC_VCA_ATTACK] / 128.0, 4) * 10000;
-  double vca_decay   = pow(instance->wrapper_cc[CC_VCA_DECAY] / 128.0, 4) * 10000;
-  double vca_sustain = pow(instance->wrapper_cc[CC_VCA_SUSTAIN] / 128.0, 2);
-  double vca_release = pow(instance->wrapper_cc[CC_VCA_RELEASE] / 128.0, 4) * 10000;
-  double vcf1_attack  = pow(instance->wrapper_cc[CC_VCF1_ATTACK] / 128.0, 4) * 10000;
-  double vcf1_decay   = pow(instance->wrapper_cc[CC_VCF1_DECAY] / 128.0, 4) * 10000;
-  double vcf1_sustain = pow(instance->wrapper_cc[CC_VCF1_SUSTAIN] / 128.0, 2);
-  double vcf1_release = pow(instance->wrapper_cc[CC_VCF1_RELEASE] / 128.0, 4) * 10000;
+static void cc_changed(struct instance* instance) {
+  adsr_env_set(&vca_env,
+	       pow(instance->wrapper_cc[CC_VCA_ATTACK] / 128.0, 4) * 10000,
+	       pow(instance->wrapper_cc[CC_VCA_DECAY] / 128.0, 4) * 10000,
+	       pow(instance->wrapper_cc[CC_VCA_SUSTAIN] / 128.0, 2),
+	       pow(instance->wrapper_cc[CC_VCA_RELEASE] / 128.0, 4) * 10000);
+  adsr_env_set(&vcf1_env,
+	       pow(instance->wrapper_cc[CC_VCF1_ATTACK] / 128.0, 4) * 10000,
+	       pow(instance->wrapper_cc[CC_VCF1_DECAY] / 128.0, 4) * 10000,
+	       pow(instance->wrapper_cc[CC_VCF1_SUSTAIN] / 128.0, 2),
+	       pow(instance->wrapper_cc[CC_VCF1_RELEASE] / 128.0, 4) * 10000);
 
   //double vcf2_attack  = pow(instance->wrapper_cc[CC_VCF2_ATTACK] / 128.0, 4) * 10000;
   //double vcf2_decay   = pow(instance->wrapper_cc[CC_VCF2_DECAY] / 128.0, 4) * 10000;
   //double vcf2_sustain = pow(instance->wrapper_cc[CC_VCF2_SUSTAIN] / 128.0, 2);
   //double vcf2_release = pow(instance->wrapper_cc[CC_VCF2_RELEASE] / 128.0, 4) * 10000;
 
-  double vcf_pregain = pow(instance->wrapper_cc[CC_VCF_PRE_GAIN] / 64.0, 2);
-  double reso_1 = instance->wrapper_cc[CC_VCF1_RESONANCE] / 127.0;
+  params.vcf_pregain = pow(instance->wrapper_cc[CC_VCF_PRE_GAIN] / 64.0, 2);
+  params.reso_1 = instance->wrapper_cc[CC_VCF1_RESONANCE] / 127.0;
   //double reso_2 = instance->wrapper_cc[CC_VCF2_RESONANCE] / 127.0;
   //double svf1_q = 1.0 - instance->wrapper_cc[CC_VCF1_RESONANCE] / 127.0;
   //double svf2_q = 1.0 - instance->wrapper_cc[CC_VCF2_RESONANCE] / 127.0;
-  double vcf1_clip_level = pow((instance->wrapper_cc[CC_VCF1_CLIP_LEVEL] + 1) / 64.0, 2);
+  params.vcf1_clip_level = pow((instance->wrapper_cc[CC_VCF1_CLIP_LEVEL] + 1) / 64.0, 2);
   //double vcf2_clip_level = pow((instance->wrapper_cc[CC_VCF2_CLIP_LEVEL] + 1) / 64.0, 2);
-  double volume = instance->wrapper_cc[CC_VOLUME] * instance->wrapper_cc[CC_VOLUME] / (127.0 * 127.0);
-  double drift = pow(instance->wrapper_cc[CC_DRIFT], 2) * sqrt(dt);
-  double lfo_delay = 10 * pow(instance->wrapper_cc[CC_LFO_DELAY] / 128.0, 2);
-  double lfo_freq = 20 * pow(instance->wrapper_cc[CC_LFO_FREQ] / 128.0, 2);
-  double osc_lfo = 0.05 * pow(instance->wrapper_cc[CC_OSC_LFO] / 128.0, 2);
-  double pw = 0.5 * instance->wrapper_cc[CC_PW] / 128.0;
-  double pw_lfo = 0.5 * instance->wrapper_cc[CC_PW_LFO] / 128.0;
+  params.volume = instance->wrapper_cc[CC_VOLUME] * instance->wrapper_cc[CC_VOLUME] / (127.0 * 127.0);
+  params.drift = pow(instance->wrapper_cc[CC_DRIFT], 2) * sqrt(dt);
+  params.lfo_delay = 10 * pow(instance->wrapper_cc[CC_LFO_DELAY] / 128.0, 2);
+  params.lfo_freq = 20 * pow(instance->wrapper_cc[CC_LFO_FREQ] / 128.0, 2);
+  params.osc_lfo = 0.05 * pow(instance->wrapper_cc[CC_OSC_LFO] / 128.0, 2);
+  params.pw = 0.5 * instance->wrapper_cc[CC_PW] / 128.0;
+  params.pw_lfo = 0.5 * instance->wrapper_cc[CC_PW_LFO] / 128.0;
+  params.vcf1_tracking = instance->wrapper_cc[CC_VCF1_TRACKING] / 127.0;
+  params.vcf1_cutoff = pow(2.0, (instance->wrapper_cc[CC_VCF1_CUTOFF] - 69 + 24 + 4) / 12.0);
+}
+
+// At most BLOCK_SIZE frames: the envelopes are rendered up front
+static void generate_block(struct instance* instance, int start_frame, int end_frame) {
+  for(int i = start_frame; i < end_frame; ++i) {
+    audio_out_buf[i] = 0.0;
+  }
+  adsr_env_render(&vcf1_env, vcf1_env_out, end_frame - start_frame);
+  adsr_env_render(&vca_env, vca_env_out, end_frame - start_frame);
+  double vcf_pregain = params.vcf_pregain;
+  double reso_1 = params.reso_1;
+  double vcf1_clip_level = params.vcf1_clip_level;
+  double volume = params.volume;
+  double drift = params.drift;
+  double lfo_delay = params.lfo_delay;
+  double lfo_freq = params.lfo_freq;
+  double osc_lfo = params.osc_lfo;
+  double pw = params.pw;
+  double pw_lfo = params.pw_lfo;
   FOR(v, NUM_VOICES) {
-    double svf1_freq = 440.0 * pow(osc_freq[v]/110.0, instance->wrapper_cc[CC_VCF1_TRACKING] / 127.0) * pow(2.0, (instance->wrapper_cc[CC_VCF1_CUTOFF] - 69 + 24 + 4) / 12.0);
+    double svf1_freq = 440.0 * fast_pow(osc_freq[v]/110.0, params.vcf1_tracking) * params.vcf1_cutoff;
     //double svf2_freq = 440.0 * pow(osc_freq[v]/110.0, instance->wrapper_cc[CC_VCF2_TRACKING] / 127.0) * pow(2.0, (instance->wrapper_cc[CC_VCF2_CUTOFF] - 69 + 24 + 4) / 12.0);
     for (int i = start_frame; i < end_frame; ++i) {
       double lfo_out = lfo_tick(&lfo[v], dt, lfo_delay, lfo_freq);
       double osc_out = osc_tick(&osc[v], dt, osc_freq[v] * (1 + osc_lfo * lfo_out) + (rand()*2.0/RAND_MAX - 1.0) * drift);
       osc_out = osc_out > pw + pw_lfo * lfo_out ? 0.6 : -0.6;
-      double vcf1_env_out = adsr_env_tick(&vcf1_env[v], dt, vcf1_attack, vcf1_decay, vcf1_sustain, vcf1_release, gain[v], 2);
-      //double vcf2_env_out = adsr_env_tick(&vcf2_env[v], dt, vcf2_attack, vcf2_decay, vcf2_sustain, vcf2_release, gain[v], 2);
-      double f1 = svf1_freq * vcf1_env_out;
-      //double f2 = svf2_freq / vcf2_env_out;
+      //double f2 = svf2_freq / vcf2_env_out[i - start_frame][v];
+      double f1 = svf1_freq * vcf1_env_out[i - start_frame][v];
       double svf_out_1 = ladder_tick(&ladder[v], dt, f1, 6 * reso_1, vcf1_clip_level, osc_out * vcf_pregain);
       //double svf_out_1 = svf_tick_nonlinear(&svf[v], dt, f1, svf1_q, osc_out * vcf_pregain);
       //double svf_out_1 = ms20_filter_tick_lp(&ms20_filter_1[v], dt, f1, reso_1, vcf1_clip_level, osc_out * vcf_pregain);
       //double svf_out_2 = ms20_filter_tick_lp(&ms20_filter_2[v], dt, f2, reso_2, vcf2_clip_level, svf_out_1);
-      double vca_env_out = adsr_env_tick(&vca_env[v], dt, vca_attack, vca_decay, vca_sustain, vca_release, gain[v], 0);
-      audio_out_buf[i] += svf_out_1 * vca_env_out * volume;
+      audio_out_buf[i] += svf_out_1 * vca_env_out[i - start_frame][v] * volume;
     }
   }
 }
 
+static void generate_audio(struct instance* instance, int start_frame, int end_frame) {
+  for (int i = start_frame; i < end_frame; i += BLOCK_SIZE) {
+    generate_block(instance, i, i + BLOCK_SIZE < end_frame ? i + BLOCK_SIZE : end_frame);
+  }
+}
+
 void plugin_process(struct instance* instance, int nframes) {
   int num_events = wrapper_get_num_midi_events(midi_in_buf);
   int sample_index = 0;
@@ -248,6 +296,8 @@ void plugin_init(struct instance* instance, double sample_rate) {
   wrapper_add_cc(instance, CC_OSC_LFO, "OSC LFO", "osc_lfo", 64);
   wrapper_add_cc(instance, CC_PW, "PW", "pw", 64);
   wrapper_add_cc(instance, CC_PW_LFO, "PW LFO", "pw_lfo", 64);
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
 }
 
 void plugin_destroy(struct instance* instance) {
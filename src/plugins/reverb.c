@@ -6,6 +6,8 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
+#include "../wrappers/tail.h"
 
 const char* plugin_name = "Reverb";
 const char* plugin_persistence_name = "mjack_reverb";
@@ -36,6 +38,8 @@ struct reverb {
   float* tank_buf;
   int tank_len;
   int base;
+  struct tail_scan tail_scan;
+  struct arena arena;
 };
 #define SQRT_ONE_HALF 0.707106781
 
@@ -62,11 +66,16 @@ static void init_buf_offs(struct reverb* r) {
   }
 }
 
+static int tank_len(double nframes_per_second) {
+  return (int)(nframes_per_second * 1.0);
+}
+
 static void init(struct reverb* r, double nframes_per_second) {
   r->dt = 1.0 / nframes_per_second;
-  r->tank_len = (int)(nframes_per_second * 1.0);
-  r->tank_buf = calloc(r->tank_len, sizeof(float));
+  r->tank_len = tank_len(nframes_per_second);
+  r->tank_buf = arena_alloc(&r->arena, r->tank_len * sizeof(float));
   init_buf_offs(r);
+  tail_scan_init(&r->tail_scan);
 }
 
 static void mix4(struct reverb* r, int s, int n, double k, double a) {
@@ -157,6 +166,8 @@ void plugin_process(struct instance* instance, int nframes) {
   double decay_gain = instance->wrapper_cc[CC_DECAY] / 127.0;
   double damping_coeff = instance->wrapper_cc[CC_DAMPING] / 127.0; // TODO sample-rate depending
   int stage = instance->wrapper_cc[CC_STAGES] * (NUM_STAGES / 2) / 128;
+  int adding = instance->wrapper_run_adding;
+  double out_gain = adding ? instance->wrapper_run_adding_gain : 1.0;
   int io_base = 0;
   while (nframes > 0) {
     int n = nframes;
@@ -179,12 +190,13 @@ void plugin_process(struct instance* instance, int nframes) {
     FOR(i, n) {
       double out[NUM_OUTS];
       FOR(o, NUM_OUTS) {
-	out[o] = reverb_gain * r->buf[NUM_STAGES/2*o+stage][0][i];
+	out[o] = out_gain * reverb_gain * r->buf[NUM_STAGES/2*o+stage][0][i];
 	r->buf[NUM_STAGES/2*o][0][i] *= feedback_gain;
 	r->buf[NUM_STAGES/2*o][0][i] += r->inbufs[o][io_base + i];
       }
       FOR(o, NUM_OUTS) {
-	r->outbufs[o^1][io_base + i] = out[o];
+	if (adding) r->outbufs[o^1][io_base + i] += out[o];
+	else r->outbufs[o^1][io_base + i] = out[o];
       }
     }
     if (MIX_SIZE == 4) FOR(s, NUM_STAGES) mix4(r, s, n, decay_gain, damping_coeff);
@@ -211,10 +223,33 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_INPUT("in 1"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+  PLUGIN_CC(CC_WET_LEVEL, "Wet"),
+  PLUGIN_CC(CC_FEEDBACK, "Feedback"),
+  PLUGIN_CC(CC_DECAY, "Decay"),
+  PLUGIN_CC(CC_DAMPING, "Damping"),
+  PLUGIN_CC(CC_STAGES, "Stages"),
+)
+
+static float tail(struct instance* instance, int nframes) {
+  struct reverb* r = instance->plugin;
+  float peak = tail_scan(&r->tail_scan, instance, r->tank_buf, r->tank_len, nframes);
+  FOR(s, NUM_STAGES) peak = fmaxf(peak, fabs(r->z[s]));
+  return peak;
+}
+
 void plugin_init(struct instance* instance, double sample_rate) {
-  struct reverb* r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  struct arena arena;
+  arena_init(&arena, arena_size(sizeof(struct reverb)) + arena_size(tank_len(sample_rate) * sizeof(float)));
+  struct reverb* r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_can_run_adding = 1;
+  instance->plugin_tail = tail;
   init(r, sample_rate);
 #define MAX_NAME_LENGTH 16
   static char inname[NUM_INS][MAX_NAME_LENGTH];
@@ -232,8 +267,6 @@ void plugin_init(struct instance* instance, double sample_rate) {
 
 void plugin_destroy(struct instance* instance) {
   struct reverb* r = instance->plugin;
-  free(r->tank_buf);
-  r->tank_buf = NULL;
-  free(instance->plugin);
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
@@ -6,6 +6,8 @@
 #include <string.h>
 #include <malloc.h>
 #include "../wrappers/wrapper.h"
+#include "../wrappers/arena.h"
+#include "../wrappers/tail.h"
 
 const char* plugin_name = "Reverb2";
 const char* plugin_persistence_name = "mjack_reverb2";
@@ -34,7 +36,11 @@ struct reverb {
   int max_tank_len;
   int tank_len;
   int base;
+  float gain[NUM_STAGES];
+  float diff[NUM_STAGES];
   float sample_rate;
+  struct tail_scan tail_scan;
+  struct arena arena;
 };
 
 static int tank_len(float sample_rate, float size_seconds) {
@@ -65,7 +71,7 @@ static void init_buf_offs(struct reverb *r, double size_seconds) {
 static void init(struct reverb *r, double nframes_per_second) {
   r->sample_rate = nframes_per_second;
   r->max_tank_len = tank_len(r->sample_rate, MAX_SIZE_SECONDS);
-  r->tank_buf = calloc(r->max_tank_len, sizeof(float));
+  r->tank_buf = arena_alloc(&r->arena, r->max_tank_len * sizeof(float));
   srand(1053);
   FOR(o, NUM_OUTS) {
     FOR(s, NUM_STAGES) {
@@ -74,24 +80,29 @@ static void init(struct reverb *r, double nframes_per_second) {
       }
     }
   }
+  tail_scan_init(&r->tail_scan);
 }
 
 static float square(float x) {
   return x * x;
 }
 
-void plugin_process(struct instance* instance, int nframes) {
+static void cc_changed(struct instance* instance) {
   struct reverb *r = instance->plugin;
   float size_seconds = square((1 + instance->wrapper_cc[CC_SIZE]) / 128.0) * MAX_SIZE_SECONDS;
-  float gain[NUM_STAGES];
-  float diff[NUM_STAGES];
   FOR(i, NUM_STAGES) {
-    gain[i] = square(instance->wrapper_cc[CC_GAIN + i] / 127.0);
-    diff[i] = 0.5 * (instance->wrapper_cc[CC_DIFF + i] / 127.0);
+    r->gain[i] = square(instance->wrapper_cc[CC_GAIN + i] / 127.0);
+    r->diff[i] = 0.5 * (instance->wrapper_cc[CC_DIFF + i] / 127.0);
   }
-  int io_base = 0;
   init_buf_offs(r, size_seconds);
   r->base %= r->tank_len;
+}
+
+void plugin_process(struct instance* instance, int nframes) {
+  struct reverb *r = instance->plugin;
+  const float *gain = r->gain;
+  const float *diff = r->diff;
+  int io_base = 0;
   while (nframes > 0) {
     int n = nframes;
     if (n > BUF_LEN) n = BUF_LEN;
@@ -173,10 +184,34 @@ void plugin_process(struct instance* instance, int nframes) {
   }
 }
 
+#define STAGE_CCS(cc, label)			\
+  PLUGIN_CC(cc + 0, label " 0"),		\
+  PLUGIN_CC(cc + 1, label " 1"),		\
+  PLUGIN_CC(cc + 2, label " 2"),		\
+  PLUGIN_CC(cc + 3, label " 3")
+
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in 0"),
+  PLUGIN_AUDIO_INPUT("in 1"),
+  PLUGIN_AUDIO_OUTPUT("out 0"),
+  PLUGIN_AUDIO_OUTPUT("out 1"),
+  PLUGIN_CC(CC_SIZE, "Size"),
+  STAGE_CCS(CC_GAIN, "Gain"),
+  STAGE_CCS(CC_DIFF, "Diff"),
+)
+
+static float tail(struct instance* instance, int nframes) {
+  struct reverb *r = instance->plugin;
+  return tail_scan(&r->tail_scan, instance, r->tank_buf, r->tank_len, nframes);
+}
+
 void plugin_init(struct instance* instance, double sample_rate) {
-  struct reverb *r = memalign(4096, sizeof(struct reverb));
-  memset(r, 0, sizeof(struct reverb));
+  struct arena arena;
+  arena_init(&arena, arena_size(sizeof(struct reverb)) + arena_size(tank_len(sample_rate, MAX_SIZE_SECONDS) * sizeof(float)));
+  struct reverb *r = arena_alloc(&arena, sizeof(struct reverb));
+  r->arena = arena;
   instance->plugin = r;
+  instance->plugin_tail = tail;
   init(r, sample_rate);
 #define MAX_NAME_LENGTH 16
   static char inname[NUM_OUTS][MAX_NAME_LENGTH];
@@ -196,12 +231,12 @@ void plugin_init(struct instance* instance, double sample_rate) {
   wrapper_add_cc(instance, CC_SIZE, "Size", "size", 64);
   FOR(i, NUM_STAGES) wrapper_add_cc(instance, CC_GAIN+i, gainname1[i], gainname2[i], 0);
   FOR(i, NUM_STAGES) wrapper_add_cc(instance, CC_DIFF+i, diffname1[i], diffname2[i], 0);
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
 }
 
 void plugin_destroy(struct instance* instance) {
   struct reverb *r = instance->plugin;
-  free(r->tank_buf);
-  r->tank_buf = NULL;
-  free(instance->plugin);
+  arena_free(&r->arena);
   instance->plugin = NULL;
 }
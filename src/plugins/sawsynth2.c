@@ -70,7 +70,7 @@ struct lpf {
   double im;
 };
 
-void lpf_tick(struct lpf *lpf, double pole_re, double pole_im, double dt, double input_A) {
+static void lpf_tick(struct lpf *lpf, double pole_re, double pole_im, double dt, double input_A) {
   if (pole_im <= 0 || pole_re >= 0) {
     return;
   }
@@ -104,7 +104,7 @@ void lpf_tick(struct lpf *lpf, double pole_re, double pole_im, double dt, double
 }
 */
 
-double lpf_sample(struct lpf *lpf) {
+static double lpf_sample(struct lpf *lpf) {
   return lpf->re;
 }
 
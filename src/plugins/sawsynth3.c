@@ -3,6 +3,9 @@
 #include <limits.h>
 #include <unistd.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
+#include "../dsp/svf.h"
 
 const char* plugin_name = "SawSynth3";
 const char* plugin_persistence_name = "mjack_sawsynth3";
@@ -44,110 +47,10 @@ struct osc_state {
 static struct osc_state osc1_state;
 static struct osc_state osc2_state;
 
-struct svf_state {
-  double last_input;
-  double z1, z2;
-};
-
-static struct svf_state svf_state;
+static struct svf svf_state;
+static struct svf_control svf_control;
 static double env_state;
 
-#if 0
-static double svf_tick(struct svf_state* state, double input, double freq, double q) {
-  freq *= dt;
-  if (freq > 0.499) {
-    freq = 0.499;
-  }
-  double omega = 2 * M_PI * freq;
-  /*                                                                          
-    // compute output                                                          
-
-    double hp = in - q * bp - lp;
-    double bp = z1 + f * hp;
-    double lp = z2 + f * bp;
-
-    // update state
-
-    z1 += 2 * f * hp;
-    z2 += 2 * f * bp;
-
-    // solve for hp
-
-    hp = in - q * (z1 + f * hp) - (z2 + f * (z1 + f * hp))
-       = in - q * z1  - q * f * hp - z2 - f * z1 - f * f * hp
-
-    (1 + q * f + f * f) hp = in - (q + f) * z1 - z2;
-  */
-
-  double f = tan(0.5 * omega);
-  double r = f + q;
-  double g = 1 / (f * r + 1);
-
-  // calculate outputs
-  double hp = (input - r * state->z1 - state->z2) * g;
-  double bp = state->z1 + f * hp;
-  double lp = state->z2 + f * bp;
-
-  // update state
-  state->z1 = bp + f * hp;
-  state->z2 = lp + f * bp;
-
-  return lp;
-}
-#endif
-static double shape(double x) {
-  return fabs(x) < 1e-12 ? 1.0 : tanh(x) / x;
-}
-
-static double svf_tick_nonlinear(struct svf_state* state, double input, double freq, double q, double grit) {
-  freq *= dt;
-  if (freq > 0.499) {
-    freq = 0.499;
-  }
-  double omega = 2 * M_PI * freq;
-  /*                                                                          
-    // compute output                                                          
-
-    double hp = in - q * bp - lp;
-    double bp = z1 + f * tanh(hp) = z1 + k1 * hp where k1 = f * tanh(hp)/hp
-    double lp = z2 + f * tanh(lp) = z2 + k2 * lp where k2 = f * tanh(lp)/lp
-
-    // update state
-
-    z1 += 2 * k1 * hp;
-    z2 += 2 * k2 * bp;
-
-    // solve for hp
-
-    hp = in - q * (z1 + k1 * hp) - (z2 + k2 * (z1 + k1 * hp))
-       = in - q * z1  - q * k1 * hp - z2 - k2 * z1 - k1 * k2 * hp
-
-    (1 + q * k1 + k1 * k2) hp = in - (q + k2) * z1 - z2;
-  */
-
-  double f = tan(0.5 * omega);
-
-  grit *= grit;
-  double half_delayed_input = (input + state->last_input) * 0.5;
-  double fb = half_delayed_input - q * state->z1 - state->z2;
-  double k1 = f * shape(fb * grit);
-  double k2 = f * shape(state->z2 * grit);
-
-  double r = q + k2;
-  double g = 1 / (k1 * r + 1);
-
-  // calculate outputs
-  double hp = (input - r * state->z1 - state->z2) * g;
-  double bp = state->z1 + k1 * hp;
-  double lp = state->z2 + k2 * bp;
-
-  // update state
-  state->last_input = input;
-  state->z1 = bp + k1 * hp;
-  state->z2 = lp + k2 * bp;
-
-  return lp;
-}
 
 
 static void init(double sample_rate) {
@@ -213,7 +116,8 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
     double osc2 = tick_osc(&osc2_state, osc2_freq);
     double osc = detune == 0 ? osc1 : (osc1 + osc2) * 0.707;
     double env = env_state += (gain - env_state) * 2 * 3.141592 * env_freq * dt;
-    double svf = svf_tick_nonlinear(&svf_state, osc, svf_freq * (1+10*env), svf_q, svf_grit);
+    double svf_f = svf_control_tick(&svf_control, dt, svf_freq * (1+10*env));
+    double svf = svf_tick_nonlinear_f(&svf_state, svf_f, svf_q, svf_grit, osc);
     audio_out_buf[i] = svf * env * volume;
   }
 }
@@ -47,7 +47,7 @@ static double dt;
 #define CC_VIBRATO_ENVELOPE 92
 
 #define NUM_OSC 3
-#define NUM_BP 3
+#define NUM_BP 3 // in the lanes of one biquad4d
 
 // dsp control values
 static double gain;
@@ -69,7 +69,8 @@ static double osc_tick(struct osc_state *_, double freq) {
 }
 
 static struct osc_state osc_state[NUM_OSC];
-static struct biquad_state bp_state[NUM_BP];
+static struct biquad4d_state bp_state;
+static struct biquad4d_coeffs bp_coeffs; // at the end of the last call
 
 static void init(double sample_rate) {
   dt = 1.0 / sample_rate;
@@ -159,10 +160,12 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
       .g2 = 0,
     };
   }
-  struct biquad_coeffs bp_coeffs[NUM_BP];
+  // The filters glide to the new coefficients across the frames.
+  struct biquad4d_coeffs bp_target = { 0 }, bp_delta;
   FOR(i, NUM_BP) {
-    bp_coeffs[i] = biquad_digital_parametric_asymmetric(bp_params[i]);
+    biquad4d_set(&bp_target, i, biquad_normalize(biquad_digital_parametric_asymmetric(bp_params[i])));
   }
+  biquad4d_ramp(&bp_delta, &bp_coeffs, &bp_target, end_frame - start_frame);
   
   for (int i = start_frame; i < end_frame; ++i) {
     static double vibrato_env_state;
@@ -180,13 +183,18 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
     static double env_state;
     double env = env_state += (gain - env_state) * 2 * 3.141592 * envelope_speed * dt;
     gain -= gain * dt * decay_speed;
+    biquad4d_v bp_out, bp_in = { 0 };
+    bp_in += osc * env;
+    biquad4d_tick(&bp_coeffs, &bp_state, &bp_in, &bp_out);
+    biquad4d_advance(&bp_coeffs, &bp_delta);
     float output = 0.0;
     FOR(j, NUM_BP) {
-      output += biquad_tick(bp_coeffs[j], &bp_state[j], osc * env);
+      output += (float) bp_out[j];
     }
     hpf_state += (output - hpf_state) * 100 * dt;
     audio_out_buf[i] = output - hpf_state;
   }
+  bp_coeffs = bp_target;
 }
 
 void plugin_process(struct instance* instance, int nframes) {
@@ -11,7 +11,10 @@
 
 #include "../wrappers/wrapper.h"
 #include "../dsp/osc.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
 #include "../dsp/ladder.h"
+#include "../dsp/prewarp.h"
 #include "../dsp/ms20-filter.h"
 #include "../dsp/lfo.h"
 #include "../dsp/adsr-env.h"
@@ -82,6 +85,7 @@ static struct osc osc[NUM_VOICES];
 static struct lfo osc_pwm_lfo[NUM_VOICES];
 static struct lfo osc_vibrato_lfo[NUM_VOICES];
 static struct ladder lpf[NUM_VOICES];
+static struct prewarp lpf_table;
 static struct simple_env env1[NUM_VOICES];
 static struct simple_env env2[NUM_VOICES];
 
@@ -89,6 +93,7 @@ static void init(double sample_rate) {
   dt = 1.0 / sample_rate;
   recip_sqrt_dt = 1.0 / sqrt(dt);
   printf("dt = %lg\n", dt);
+  prewarp_init(&lpf_table, sample_rate, ladder_coeff);
 }
 static void handle_midi_note_off(int key, int velocity) {
   if (key_is_pressed[key]) {
@@ -135,10 +140,6 @@ static void handle_midi_event(struct instance* instance, const struct midi_event
       handle_midi_note_on(instance, event->buffer[1], event->buffer[2]);
     }
     break;
-  case 0xB0:
-    fprintf(stderr, "Received CC %i -> %i\n", event->buffer[1], event->buffer[2]);
-    instance->wrapper_cc[event->buffer[1]] = event->buffer[2];
-    break;
   }
 }
 
@@ -195,19 +196,19 @@ static void generate_audio(struct instance* instance, int start_frame, int end_f
 
       lin_drift_lpf[v] += (lin_drift_noise * recip_sqrt_dt - lin_drift_lpf[v]) * drift_coeff;
       log_drift_lpf[v] += (log_drift_noise * recip_sqrt_dt - log_drift_lpf[v]) * drift_coeff;
-      double osc_final_freq = 440.0 * pow(2, (pitch + osc_vibrato_depth * vibrato_lfo_out) / 12.0) * (1 + log_drift_lpf[v]) + lin_drift_lpf[v];
+      double osc_final_freq = 440.0 * fast_exp2((pitch + osc_vibrato_depth * vibrato_lfo_out) / 12.0) * (1 + log_drift_lpf[v]) + lin_drift_lpf[v];
 
       double saw_out = osc_tick(&osc[v], dt, osc_final_freq);
       double pulse_out = saw_out > osc_final_pw ? 0.6 : -0.6;
       double osc_out = (1 - osc_mix) * saw_out + osc_mix * pulse_out;
 
-      double lpf_final_cutoff = 440.0 * pow(2.0, (lpf_pitch + lpf_tracking * (pitch + 24.0) + lpf_env1 * env1_out + lpf_env2 * env2_out) / 12.0);
+      double lpf_final_pitch = 69 + lpf_pitch + lpf_tracking * (pitch + 24.0) + lpf_env1 * env1_out + lpf_env2 * env2_out;
 
-      //double lpf_out = ladder_tick(&lpf[v], dt, lpf_final_cutoff, 9 * lpf_reso, 1.0, osc_out);
-      double lpf_out = ladder_tick_nonlinear_blt(&lpf[v], dt, lpf_final_cutoff, 9 * lpf_reso, 1., osc_out * 0.5);
+      //double lpf_out = ladder_tick_k(&lpf[v], prewarp_pitch(&lpf_table, lpf_final_pitch), 9 * lpf_reso, 1.0, osc_out);
+      double lpf_out = ladder_tick_nonlinear_blt_k(&lpf[v], prewarp_pitch(&lpf_table, lpf_final_pitch), 9 * lpf_reso, 1., osc_out * 0.5);
 
       double volume = (1 - volume_env_mix) * env1_out + volume_env_mix * env2_out;
-      audio_out_buf[i] += tanh(lpf_out * volume * drive * 4) * 0.25 * gain;
+      audio_out_buf[i] += fast_tanh(lpf_out * volume * drive * 4) * 0.25 * gain;
     }
   }
 }
@@ -1,10 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E5
+#include "../dsp/fastmath.h"
+#include "../dsp/smooth.h"
 
 const char* plugin_name = "TanhDistortion";
 const char* plugin_persistence_name = "mjack_tanh_distortion";
@@ -20,29 +25,64 @@ enum {
 #undef X
 };
 
+#define SMOOTH_SECONDS 0.02
+
+enum { S_DRIVE, S_GAIN };
+
 struct filter {
   float *in;
   float *out;
+  struct smooth smooth;
 };
 
+static void cc_changed(struct instance* instance) {
+  struct filter *h = instance->plugin;
+  smooth_set_cc(&h->smooth, instance->wrapper_cc);
+}
+
 void plugin_process(struct instance* instance, int nframes) {
   struct filter *h = instance->plugin;
-  double drive = 16 * pow((1 + instance->wrapper_cc[CC_DRIVE])/128.0, 2);
-  double gain = pow((1 + instance->wrapper_cc[CC_GAIN])/128.0, 2);
+  int moving = smooth_block(&h->smooth, nframes);
+  const float *cc0 = h->smooth.start;
+  const float *cc1 = h->smooth.value;
+  double drive = 16 * pow((1 + cc0[S_DRIVE])/128.0, 2);
+  double gain = pow((1 + cc0[S_GAIN])/128.0, 2);
 
+  if (!moving) {
+    FOR(i, nframes) {
+      h->out[i] = fast_tanh(h->in[i] * drive) * gain;
+    }
+    return;
+  }
+  double drive_step = (16 * pow((1 + cc1[S_DRIVE])/128.0, 2) - drive) / nframes;
+  double gain_step = (pow((1 + cc1[S_GAIN])/128.0, 2) - gain) / nframes;
   FOR(i, nframes) {
-    h->out[i] = tanh(h->in[i] * drive) * gain;
+    h->out[i] = fast_tanh(h->in[i] * (drive + drive_step * i)) * (gain + gain_step * i);
   }
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *h = calloc(1, sizeof(struct filter));
   instance->plugin = h;
+  smooth_init(&h->smooth, SMOOTH_LINEAR, SMOOTH_SECONDS, sample_rate);
+  smooth_add_cc(&h->smooth, CC_DRIVE);
+  smooth_add_cc(&h->smooth, CC_GAIN);
   wrapper_add_audio_input(instance, "in", &h->in);
   wrapper_add_audio_output(instance, "out", &h->out);
 #define X(name, value, label) wrapper_add_cc(instance, value, label, #name, 64);
   KNOBS
 #undef X
+  instance->plugin_cc_changed = cc_changed;
+  cc_changed(instance);
+  smooth_snap(&h->smooth);
 }
 
 void plugin_destroy(struct instance* instance) {
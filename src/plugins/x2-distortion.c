@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <math.h>
 #include "../wrappers/wrapper.h"
+#define FASTMATH_TIER FASTMATH_1E3
+#include "../dsp/fastmath.h"
 
 const char* plugin_name = "X2Distortion";
 const char* plugin_persistence_name = "mjack_x2_distortion";
@@ -46,7 +48,7 @@ void plugin_process(struct instance* instance, int nframes) {
   float * restrict out = h->out;
 
   FOR(i, nframes) {
-    float x = in[i] * drive + bias + sinf(phase * 2 * 3.141592) * depth;
+    float x = in[i] * drive + bias + fast_sinf(phase * 2 * 3.141592) * depth;
     float x2 = x * x;
     float y = x2 / (1 + x2);
     y -= hpstate;
@@ -61,6 +63,14 @@ void plugin_process(struct instance* instance, int nframes) {
   h->phase = phase;
 }
 
+#define X(name, value, label) PLUGIN_CC(value, label),
+PLUGIN_STATIC_PORTS(
+  PLUGIN_AUDIO_INPUT("in"),
+  PLUGIN_AUDIO_OUTPUT("out"),
+  KNOBS
+)
+#undef X
+
 void plugin_init(struct instance* instance, double sample_rate) {
   struct filter *f = calloc(1, sizeof(struct filter));
   f->dt = 1 / sample_rate;
@@ -0,0 +1,257 @@
+// Throughput benchmark: runs a plugin on synthetic input at a range of block
+// sizes and prints one CSV row per block size.
+//
+//   reverb-bench -r 96000 > reverb.csv
+//   polysaw-bench --block-size 64 --voices 8
+//
+// Effects get periodic impulses (or noise/sine with --signal); MIDI inputs get
+// a chord that is held for the whole run. Each block size is preceded by a
+// short warm-up that is not measured.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "wrapper.h"
+#include "offline.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define MAX_BLOCK_SIZE 4096
+#define MAX_CC_OPTIONS 128
+#define MAX_VOICES 16
+
+static struct instance instance;
+
+// MIDI: the chord is delivered once, in the first block after init.
+
+struct midi_buffer {
+  int num_events;
+  struct midi_event events[MAX_VOICES];
+};
+
+static struct midi_buffer midi_buffer;
+static unsigned char chord_bytes[MAX_VOICES][3];
+
+int wrapper_get_num_midi_events(void* buf) {
+  return ((struct midi_buffer*) buf)->num_events;
+}
+
+struct midi_event wrapper_get_midi_event(void* buf, int index) {
+  return ((struct midi_buffer*) buf)->events[index];
+}
+
+static void queue_chord(int voices) {
+  // Stacked fourths and fifths from C2 upwards; spread wide enough that no
+  // two voices share a note.
+  static const int intervals[] = { 0, 7, 12, 16, 19, 22, 24, 26, 28, 31, 34, 36, 38, 40, 43, 46 };
+  FOR(i, voices) {
+    chord_bytes[i][0] = 0x90;
+    chord_bytes[i][1] = 36 + intervals[i];
+    chord_bytes[i][2] = 100;
+    midi_buffer.events[i] = (struct midi_event) { .time = 0, .size = 3, .buffer = chord_bytes[i] };
+  }
+  midi_buffer.num_events = voices;
+}
+
+// Synthetic audio
+
+enum signal { SIGNAL_IMPULSE, SIGNAL_NOISE, SIGNAL_SINE, SIGNAL_SILENCE };
+
+static enum signal signal_type = SIGNAL_IMPULSE;
+static long signal_pos;
+static uint32_t noise_state = 22222;
+
+static void generate_signal(float* out, int n, double sample_rate) {
+  long impulse_period = sample_rate / 4;
+  FOR(i, n) {
+    long t = signal_pos + i;
+    switch (signal_type) {
+    case SIGNAL_IMPULSE: out[i] = t % impulse_period == 0 ? 1.0f : 0.0f; break;
+    case SIGNAL_NOISE:
+      noise_state = noise_state * 1664525 + 1013904223;
+      out[i] = (int32_t) noise_state * (0.5f / 2147483648.0f);
+      break;
+    case SIGNAL_SINE: out[i] = 0.5f * sinf(2 * M_PI * 440.0 * (t % (long) sample_rate) / sample_rate); break;
+    case SIGNAL_SILENCE: out[i] = 0.0f; break;
+    }
+  }
+}
+
+// Timing
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#ifdef HAVE_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct run_result {
+  double ns;
+  uint64_t cycles;
+  double worst_ns;
+};
+
+static float* input_buf[OFFLINE_MAX_PORTS];
+static float* output_buf[OFFLINE_MAX_PORTS];
+static int num_audio_inputs;
+static int num_audio_outputs;
+
+// Processes frames in blocks of block_size, timing only the plugin_process
+// calls and the coefficient updates before them.
+static struct run_result run(long frames, int block_size, double sample_rate) {
+  struct run_result r = { 0 };
+  for (long pos = 0; pos < frames; pos += block_size) {
+    FOR(i, num_audio_inputs) {
+      generate_signal(input_buf[i], block_size, sample_rate);
+    }
+    signal_pos += block_size;
+    double t0 = now_ns();
+    uint64_t c0 = now_cycles();
+    wrapper_cc_dispatch(&instance);
+    plugin_process(&instance, block_size);
+    uint64_t c1 = now_cycles();
+    double t1 = now_ns();
+    midi_buffer.num_events = 0;
+    r.ns += t1 - t0;
+    r.cycles += c1 - c0;
+    if (t1 - t0 > r.worst_ns) r.worst_ns = t1 - t0;
+  }
+  return r;
+}
+
+// Command line
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+	  "Usage: %s [options]\n"
+	  "  -r, --sample-rate HZ     default 48000\n"
+	  "  -b, --block-size N       measure only this block size (default: sweep 16..4096)\n"
+	  "  -s, --seconds SECONDS    audio processed per block size (default 10)\n"
+	  "  -g, --signal TYPE        impulse, noise, sine or silence (default impulse)\n"
+	  "  -v, --voices N           notes held on MIDI inputs (default 8)\n"
+	  "  -c, --cc NAME=VALUE      set a control by name or cc number, may be repeated\n"
+	  "  -n, --no-header          omit the CSV header line\n",
+	  argv0);
+}
+
+int main(int argc, char** argv) {
+  int sample_rate = 48000;
+  int only_block_size = 0;
+  double seconds = 10;
+  int voices = 8;
+  bool header = true;
+  const char* cc_options[MAX_CC_OPTIONS];
+  int num_cc_options = 0;
+
+  static struct option long_options[] = {
+    { "sample-rate", required_argument, 0, 'r' },
+    { "block-size", required_argument, 0, 'b' },
+    { "seconds", required_argument, 0, 's' },
+    { "signal", required_argument, 0, 'g' },
+    { "voices", required_argument, 0, 'v' },
+    { "cc", required_argument, 0, 'c' },
+    { "no-header", no_argument, 0, 'n' },
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0 },
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "r:b:s:g:v:c:nh", long_options, NULL)) != -1) {
+    switch (c) {
+    case 'r': sample_rate = atoi(optarg); break;
+    case 'b': {
+      char* end;
+      long n = strtol(optarg, &end, 10);
+      CHECK(end != optarg && !*end && n >= 1 && n <= MAX_BLOCK_SIZE, "block size must be between 1 and 4096");
+      only_block_size = n;
+      break;
+    }
+    case 's': seconds = atof(optarg); break;
+    case 'g':
+      if (!strcmp(optarg, "impulse")) signal_type = SIGNAL_IMPULSE;
+      else if (!strcmp(optarg, "noise")) signal_type = SIGNAL_NOISE;
+      else if (!strcmp(optarg, "sine")) signal_type = SIGNAL_SINE;
+      else if (!strcmp(optarg, "silence")) signal_type = SIGNAL_SILENCE;
+      else { usage(argv[0]); exit(1); }
+      break;
+    case 'v': voices = atoi(optarg); break;
+    case 'c':
+      CHECK(num_cc_options < MAX_CC_OPTIONS, "too many --cc options");
+      cc_options[num_cc_options++] = optarg;
+      break;
+    case 'n': header = false; break;
+    case 'h': usage(argv[0]); exit(0);
+    default: usage(argv[0]); exit(1);
+    }
+  }
+  if (optind < argc) {
+    usage(argv[0]);
+    exit(1);
+  }
+  CHECK(sample_rate > 0, "sample rate must be positive");
+  CHECK(voices >= 0 && voices <= MAX_VOICES, "voices must be between 0 and 16");
+
+  offline_default_tuning(&instance);
+  plugin_init(&instance, sample_rate);
+  FOR(i, num_cc_options) offline_set_cc_option(&instance, cc_options[i]);
+
+  FOR(p, offline_num_ports) {
+    void** buf = offline_port_buf[p];
+    switch (offline_port_type[p]) {
+    case PORT_AUDIO_INPUT:
+      input_buf[num_audio_inputs] = memalign(64, MAX_BLOCK_SIZE * sizeof(float));
+      CHECK(input_buf[num_audio_inputs], "out of memory");
+      *buf = input_buf[num_audio_inputs++];
+      break;
+    case PORT_AUDIO_OUTPUT:
+      output_buf[num_audio_outputs] = memalign(64, MAX_BLOCK_SIZE * sizeof(float));
+      CHECK(output_buf[num_audio_outputs], "out of memory");
+      *buf = output_buf[num_audio_outputs++];
+      break;
+    case PORT_MIDI_INPUT:
+      *buf = &midi_buffer;
+      break;
+    }
+  }
+  queue_chord(voices);
+
+  if (header) {
+    printf("plugin,sample_rate,block_size,ns_per_sample,cycles_per_sample,worst_block_us,worst_block_load\n");
+  }
+  for (int block_size = 16; block_size <= MAX_BLOCK_SIZE; block_size *= 2) {
+    int n = only_block_size ? only_block_size : block_size;
+    long frames = ceil(seconds * sample_rate / n) * n;
+    run(sample_rate / 4, n, sample_rate);
+    struct run_result r = run(frames, n, sample_rate);
+    double block_period_ns = 1e9 * n / sample_rate;
+    printf("%s,%d,%d,%.3f,", plugin_persistence_name, sample_rate, n, r.ns / frames);
+#ifdef HAVE_RDTSC
+    printf("%.1f,", (double) r.cycles / frames);
+#else
+    printf(",");
+#endif
+    printf("%.2f,%.4f\n", r.worst_ns * 1e-3, r.worst_ns / block_period_ns);
+    fflush(stdout);
+    if (only_block_size) break;
+  }
+
+  plugin_destroy(&instance);
+  FOR(i, num_audio_inputs) free(input_buf[i]);
+  FOR(i, num_audio_outputs) free(output_buf[i]);
+  return 0;
+}
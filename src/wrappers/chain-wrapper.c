@@ -0,0 +1,737 @@
+// In-process plugin chain: runs several plugins inside one JACK client.
+//
+//   mjack-chain polysaw distbox compressor ms-reverb
+//   mjack-chain --threads 4 --bus ms-reverb compressor parametric / compressor parametric
+//
+// Each stage's audio outputs feed the next stage's inputs directly in memory;
+// only the first stage's inputs and the last stage's outputs are JACK ports.
+// When channel counts differ, surplus inputs reuse the upstream outputs
+// round-robin and surplus outputs are averaged down. All MIDI inputs share one
+// JACK MIDI port, whose CC messages also drive every stage's controls.
+//
+// "/" separates independent lanes, each with its own JACK ports. With --bus,
+// the lane outputs are summed into the bus stages instead, and only the bus
+// has JACK outputs. Lanes are run in parallel by the graph executor when
+// --threads is more than 1.
+//
+// Each stage's controls are a column of sliders. Slider moves reach the stage
+// through its cc_ring at the next block boundary, and the CCs that MIDI
+// changes come back through cc_changed_ring, as in jack-plugin-host.h.
+//
+// SIGUSR1 prints DSP load statistics for the whole graph and for every stage
+// to stdout, or appends them to the --stats file. A stage whose block overran
+// the period right before an xrun is the likely culprit.
+
+#include "wrapper.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "../tuning/scala.h"
+#include <memory.h>
+#include <malloc.h>
+#include <math.h>
+#include <gtk/gtk.h>
+#include <signal.h>
+#include "plugin-table.h"
+#include "graph.h"
+#include "jack-host.h"
+#include "dsp-stats.h"
+#include "realtime.h"
+
+#define X(id, name) PLUGIN_DECLARE(id)
+CHAIN_PLUGINS
+#undef X
+
+static const struct plugin_entry plugins[] = {
+#define X(id, name) PLUGIN_ENTRY(id, name)
+  CHAIN_PLUGINS
+#undef X
+};
+#define NUM_PLUGINS ((int) (sizeof(plugins) / sizeof(plugins[0])))
+
+#define MAX_STAGES 64
+#define MAX_LANES 16
+#define MAX_STAGE_PORTS 8
+#define MAX_SOURCES 64
+#define MAX_BUFFER_SIZE 8192
+#define STATS_POLL_MS 200
+#define SLIDER_INTERVAL_MS 50
+
+struct source {
+  const float* buf;
+  float gain;
+};
+
+struct stage {
+  const struct plugin_entry* plugin;
+  int lane; // -1 for bus stages
+  struct instance instance;
+  const char* cc_persist_name[128];
+  char host_cc[128]; // the GUI's copy of instance.wrapper_cc
+  jack_ringbuffer_t* cc_ring;
+  jack_ringbuffer_t* cc_changed_ring;
+  GtkAdjustment* cc_adjustment[128];
+  GtkWidget* sliders_box;
+  int num_inputs;
+  int num_outputs;
+  int num_midi_inputs;
+  const char* input_name[MAX_STAGE_PORTS];
+  const char* output_name[MAX_STAGE_PORTS];
+  float** input[MAX_STAGE_PORTS];
+  float** output[MAX_STAGE_PORTS];
+  float* output_buf[MAX_STAGE_PORTS];
+  // Stages at the edges of the graph talk to JACK directly.
+  jack_port_t* jack_input[MAX_STAGE_PORTS];
+  jack_port_t* jack_output[MAX_STAGE_PORTS];
+  // Inputs fed by anything but a single upstream output are mixed into mix_buf.
+  int num_sources[MAX_STAGE_PORTS];
+  struct source source[MAX_STAGE_PORTS][MAX_SOURCES];
+  float* mix_buf[MAX_STAGE_PORTS];
+  struct driver driver;
+  struct dsp_stats dsp_stats;
+};
+
+// Lane stages come first, in lane order, followed by the bus stages.
+static struct stage stages[MAX_STAGES];
+static int num_stages;
+static int num_lanes;
+static int bus_start;
+
+static struct graph* graph;
+static struct dsp_stats graph_stats;
+static double period_usecs; // of the current cycle
+static jack_nframes_t cycle_start;
+static volatile sig_atomic_t stats_requested;
+
+static float silence[MAX_BUFFER_SIZE];
+
+static jack_port_t* jack_midi_input;
+static void* jack_midi_buf; // this cycle's "midi in" buffer
+
+static GtkWidget* window;
+static GtkWidget* stages_box;
+static bool updating_sliders;
+
+// Returns false, leaving host_cc alone, when cc_ring is full.
+static bool send_cc(struct stage* st, int cc_number, int value) {
+  if (!jack_host_queue_cc(st->cc_ring, cc_number, value)) return false;
+  st->host_cc[cc_number] = value;
+  return true;
+}
+
+static void cb_value_changed(GtkAdjustment* adj, struct stage* st) {
+  if (updating_sliders) return;
+  int cc_number = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(adj), "cc_number"));
+  if (!send_cc(st, cc_number, (int) gtk_adjustment_get_value(adj))) {
+    fprintf(stderr, "cc queue full, dropping cc %i of %s\n", cc_number, st->plugin->id);
+  }
+}
+
+// Shows host_cc, without sending it back to the stage
+static void update_slider(struct stage* st, int cc_number) {
+  GtkAdjustment* adj = st->cc_adjustment[cc_number];
+  if (adj != NULL) {
+    updating_sliders = true;
+    gtk_adjustment_set_value(adj, st->host_cc[cc_number]);
+    updating_sliders = false;
+  }
+}
+
+static gboolean update_sliders(gpointer data) {
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    struct cc_event ev;
+    while (jack_ringbuffer_read(st->cc_changed_ring, (char*) &ev, sizeof(ev)) == sizeof(ev)) {
+      st->host_cc[ev.cc_number] = ev.value;
+      update_slider(st, ev.cc_number);
+    }
+  }
+  return TRUE;
+}
+
+// State files hold one entry per stage:
+// {"stages": [{"plugin": "polysaw", "cc": {"cutoff": 64, ...}}, ...]}
+
+static bool save(const char* filename) {
+  struct json_object* obj = json_object_new_object();
+  json_object_object_add(obj, "info", json_object_new_string("state file for mjack chain"));
+  struct json_object* stages_obj = json_object_new_array();
+  json_object_object_add(obj, "stages", stages_obj);
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    struct json_object* stage_obj = json_object_new_object();
+    json_object_object_add(stage_obj, "plugin", json_object_new_string(st->plugin->id));
+    json_object_object_add(stage_obj, "cc", jack_host_cc_object(st->cc_persist_name, st->host_cc));
+    json_object_array_add(stages_obj, stage_obj);
+  }
+  return jack_host_write_state(filename, obj);
+}
+
+static void load_stage(struct stage* st, struct json_object* stage_obj) {
+  struct json_object* tmp = NULL;
+  if (!json_object_object_get_ex(stage_obj, "plugin", &tmp) || !tmp ||
+      strcmp(json_object_get_string(tmp), st->plugin->id)) {
+    fprintf(stderr, "Saved stage does not match %s, skipping\n", st->plugin->id);
+    return;
+  }
+  struct json_object* cc_obj = NULL;
+  if (!json_object_object_get_ex(stage_obj, "cc", &cc_obj) || !cc_obj) return;
+  FOR(i, 128) {
+    int value;
+    if (!st->cc_persist_name[i] || !jack_host_read_cc(cc_obj, i, st->cc_persist_name[i], &value)) continue;
+    if (!send_cc(st, i, value)) {
+      fprintf(stderr, "cc queue full, dropping cc %i of %s\n", i, st->plugin->id);
+      continue;
+    }
+    update_slider(st, i);
+  }
+}
+
+static void load(const char* filename) {
+  struct json_object* obj = jack_host_read_state(filename);
+  if (!obj) return;
+  struct json_object* stages_obj = NULL;
+  if (json_object_object_get_ex(obj, "stages", &stages_obj) && stages_obj) {
+    int n = json_object_array_length(stages_obj);
+    if (n > num_stages) n = num_stages;
+    FOR(s, n) load_stage(&stages[s], json_object_array_get_idx(stages_obj, s));
+  } else {
+    fprintf(stderr, "error while loading %s\n", filename);
+  }
+  json_object_put(obj);
+}
+
+void wrapper_add_cc(struct instance* instance, int cc_number, const char* display_name, const char* persist_name, int default_value) {
+  struct stage* st = instance->wrapper;
+  wrapper_set_cc(instance, cc_number, default_value);
+  st->host_cc[cc_number] = default_value;
+  st->cc_persist_name[cc_number] = persist_name;
+  GtkWidget* slider_box = gtk_hbox_new(FALSE, 0);
+  GtkObject* adj = gtk_adjustment_new(instance->wrapper_cc[cc_number], 0, 127, 1, 16, 0);
+  st->cc_adjustment[cc_number] = GTK_ADJUSTMENT(adj);
+  g_object_set_data(G_OBJECT(adj), "cc_number", GINT_TO_POINTER(cc_number));
+  g_signal_connect(adj, "value_changed", G_CALLBACK(cb_value_changed), st);
+  GtkWidget* label = gtk_label_new(display_name);
+  gtk_box_pack_start(GTK_BOX(slider_box), label, FALSE, FALSE, FALSE);
+  gtk_widget_show(label);
+  GtkWidget* scale = gtk_hscale_new(GTK_ADJUSTMENT(adj));
+  gtk_widget_set_size_request(scale, 300, 30);
+  gtk_scale_set_digits(GTK_SCALE(scale), 0);
+  gtk_box_pack_start(GTK_BOX(slider_box), scale, FALSE, FALSE, FALSE);
+  gtk_widget_show(scale);
+  gtk_box_pack_start(GTK_BOX(st->sliders_box), slider_box, FALSE, FALSE, FALSE);
+  gtk_widget_show(slider_box);
+}
+
+void wrapper_add_audio_input(struct instance* instance, const char* name, float** buf) {
+  struct stage* st = instance->wrapper;
+  CHECK(st->num_inputs < MAX_STAGE_PORTS, "too many ports");
+  int i = st->num_inputs++;
+  st->input_name[i] = name;
+  st->input[i] = buf;
+  driver_add_audio(&st->driver, buf, false);
+}
+
+void wrapper_add_audio_output(struct instance* instance, const char* name, float** buf) {
+  struct stage* st = instance->wrapper;
+  CHECK(st->num_outputs < MAX_STAGE_PORTS, "too many ports");
+  int i = st->num_outputs++;
+  st->output_name[i] = name;
+  st->output[i] = buf;
+  driver_add_audio(&st->driver, buf, true);
+}
+
+void wrapper_add_midi_input(struct instance* instance, const char* name, void** buf) {
+  struct stage* st = instance->wrapper;
+  st->num_midi_inputs++;
+  driver_add_midi(&st->driver, buf);
+}
+
+static float* alloc_buffer(void) {
+  float* buf = memalign(64, MAX_BUFFER_SIZE * sizeof(float));
+  CHECK(buf, "out of memory");
+  memset(buf, 0, MAX_BUFFER_SIZE * sizeof(float));
+  return buf;
+}
+
+static bool is_lane_start(int s) {
+  return s < bus_start && (s == 0 || stages[s - 1].lane != stages[s].lane);
+}
+
+static bool is_lane_end(int s) {
+  return s < bus_start && (s + 1 == bus_start || stages[s + 1].lane != stages[s].lane);
+}
+
+static bool has_jack_outputs(int s) {
+  return bus_start < num_stages ? s == num_stages - 1 : is_lane_end(s);
+}
+
+static void add_source(struct stage* st, int input, const float* buf, float gain) {
+  CHECK(st->num_sources[input] < MAX_SOURCES, "too many sources");
+  st->source[input][st->num_sources[input]++] = (struct source) { buf, gain };
+}
+
+// Feeds input i of st from the outputs of up, using the channel mapping
+// described at the top of this file.
+static void add_sources(struct stage* st, int i, struct stage* up) {
+  if (up->num_outputs == 0) return;
+  if (up->num_outputs <= st->num_inputs) {
+    add_source(st, i, up->output_buf[i % up->num_outputs], 1.0f);
+  } else {
+    int n = (up->num_outputs - i + st->num_inputs - 1) / st->num_inputs;
+    for (int o = i; o < up->num_outputs; o += st->num_inputs) add_source(st, i, up->output_buf[o], 1.0f / n);
+  }
+}
+
+// Points every stage's inputs at its upstream outputs. Inputs at the start
+// of a lane and outputs at the end of the graph are JACK buffers and are set
+// in process_cb instead.
+static void wire_stages(void) {
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    if (!has_jack_outputs(s)) {
+      FOR(o, st->num_outputs) {
+	st->output_buf[o] = alloc_buffer();
+	*st->output[o] = st->output_buf[o];
+      }
+    }
+  }
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    if (is_lane_start(s)) continue;
+    bool has_upstream_audio = false;
+    if (s == bus_start) {
+      FOR(t, bus_start) {
+	if (!is_lane_end(t)) continue;
+	FOR(i, st->num_inputs) add_sources(st, i, &stages[t]);
+	has_upstream_audio |= stages[t].num_outputs > 0;
+      }
+    } else {
+      FOR(i, st->num_inputs) add_sources(st, i, &stages[s - 1]);
+      has_upstream_audio = stages[s - 1].num_outputs > 0;
+    }
+    if (has_upstream_audio && st->num_inputs == 0) {
+      fprintf(stderr, "Warning: %s has no audio inputs, upstream audio is dropped\n", st->plugin->id);
+    }
+    FOR(i, st->num_inputs) {
+      if (st->num_sources[i] == 0) {
+	*st->input[i] = silence;
+      } else if (st->num_sources[i] == 1 && st->source[i][0].gain == 1.0f) {
+	*st->input[i] = (float*) st->source[i][0].buf;
+      } else {
+	st->mix_buf[i] = alloc_buffer();
+	*st->input[i] = st->mix_buf[i];
+      }
+    }
+  }
+}
+
+static void mix_sources(struct stage* st, int input, int nframes) {
+  float* out = st->mix_buf[input];
+  const struct source* src = st->source[input];
+  FOR(j, nframes) out[j] = src[0].gain * src[0].buf[j];
+  for (int k = 1; k < st->num_sources[input]; k++) {
+    FOR(j, nframes) out[j] += src[k].gain * src[k].buf[j];
+  }
+}
+
+// Passes the CCs that MIDI changed on to the sliders. Those that do not fit
+// into cc_changed_ring stay marked for the next block.
+static void send_changed_ccs(struct stage* st) {
+  uint64_t* changed = st->driver.cc_changed;
+  if (!changed[0] && !changed[1]) return;
+  FOR(cc, 128) {
+    uint64_t bit = (uint64_t) 1 << (cc & 63);
+    if (!(changed[cc >> 6] & bit)) continue;
+    struct cc_event ev = { 0, cc, st->instance.wrapper_cc[cc] };
+    if (jack_ringbuffer_write_space(st->cc_changed_ring) < sizeof(ev)) return;
+    jack_ringbuffer_write(st->cc_changed_ring, (const char*) &ev, sizeof(ev));
+    changed[cc >> 6] &= ~bit;
+  }
+}
+
+static void run_stage(void* arg, int nframes) {
+  struct stage* st = arg;
+  // Stages run on the JACK thread and on the graph workers alike.
+  if (option_realtime) realtime_denormals_off();
+  jack_time_t start = jack_get_time();
+  uint64_t start_cycles = dsp_stats_cycles();
+  FOR(i, st->num_inputs) if (st->mix_buf[i]) mix_sources(st, i, nframes);
+  jack_host_apply_ccs(st->cc_ring, &st->instance, cycle_start);
+  driver_process(&st->driver, &st->instance, jack_midi_buf, nframes);
+  send_changed_ccs(st);
+  dsp_stats_record(&st->dsp_stats, jack_get_time() - start, dsp_stats_cycles() - start_cycles, period_usecs);
+}
+
+static int process_cb(jack_nframes_t nframes, void* arg) {
+  if (nframes > MAX_BUFFER_SIZE) return 1;
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    if (is_lane_start(s)) {
+      FOR(i, st->num_inputs) {
+	*st->input[i] = jack_port_get_buffer(st->jack_input[i], nframes);
+	if (!*st->input[i]) return 1;
+      }
+    }
+    if (has_jack_outputs(s)) {
+      FOR(i, st->num_outputs) {
+	*st->output[i] = jack_port_get_buffer(st->jack_output[i], nframes);
+	if (!*st->output[i]) return 1;
+      }
+    }
+  }
+  jack_midi_buf = jack_port_get_buffer(jack_midi_input, nframes);
+  if (!jack_midi_buf) return 1;
+  FOR(s, num_stages) FOR(m, stages[s].num_midi_inputs) driver_set_midi(&stages[s].driver, m, jack_midi_buf);
+  period_usecs = nframes * 1e6 / jack_get_sample_rate(jack_client);
+  cycle_start = jack_last_frame_time(jack_client);
+  jack_time_t start = jack_get_time();
+  uint64_t start_cycles = dsp_stats_cycles();
+  graph_run(graph, nframes);
+  dsp_stats_record(&graph_stats, jack_get_time() - start, dsp_stats_cycles() - start_cycles, period_usecs);
+  return 0;
+}
+
+static int xrun_cb(void* arg) {
+  dsp_stats_xrun(&graph_stats);
+  FOR(s, num_stages) dsp_stats_xrun(&stages[s].dsp_stats);
+  return 0;
+}
+
+static void sigusr1_handler(int sig) {
+  stats_requested = 1;
+}
+
+static const char* option_name = "mjack_chain";
+static int option_threads = 1;
+static const char* option_bus;
+
+static void report_stats(void) {
+  FILE* f = dsp_stats_open(option_stats);
+  dsp_stats_print(f, jack_get_client_name(jack_client), &graph_stats);
+  FOR(s, num_stages) {
+    char name[128];
+    snprintf(name, sizeof(name), "  stage %d %s", s + 1, stages[s].plugin->id);
+    dsp_stats_print(f, name, &stages[s].dsp_stats);
+  }
+  dsp_stats_close(f);
+}
+
+static gboolean check_stats_request(gpointer data) {
+  if (stats_requested) {
+    stats_requested = 0;
+    report_stats();
+  }
+  return TRUE;
+}
+
+static int gui_session_cb( void *data )
+{
+  char name[256], args[768];
+  jack_host_quote(name, sizeof(name), option_name);
+  int len = snprintf(args, sizeof(args), " --name=%s --threads=%d", name, option_threads);
+  for (int s = bus_start; s < num_stages; s++) {
+    if (len < (int) sizeof(args)) {
+      len += snprintf(args + len, sizeof(args) - len, "%s%s", s == bus_start ? " --bus=" : ",", stages[s].plugin->id);
+    }
+  }
+  FOR(s, bus_start) {
+    if (len < (int) sizeof(args)) {
+      len += snprintf(args + len, sizeof(args) - len, "%s %s", s > 0 && is_lane_start(s) ? " /" : "", stages[s].plugin->id);
+    }
+  }
+
+  if (jack_host_session_reply((jack_session_event_t *) data, save, args))
+    gtk_main_quit();
+
+  return 0;
+}
+
+static void session_cb(jack_session_event_t *event, void *arg)
+{
+  g_idle_add(gui_session_cb, event);
+}
+
+static void load_scale(void) {
+  GtkWidget *dialog =
+    gtk_file_chooser_dialog_new("Open Scala Scale File",
+				GTK_WINDOW(window),
+				GTK_FILE_CHOOSER_ACTION_OPEN,
+				GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+				GTK_STOCK_OPEN, GTK_RESPONSE_ACCEPT,
+				NULL);
+  if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+    char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+    float cents[128];
+    float freq[128];
+    bool ok = load_scala_file(filename, cents, freq);
+    if (ok) {
+      FOR(s, num_stages) {
+	memcpy(stages[s].instance.cents, cents, sizeof(cents));
+	memcpy(stages[s].instance.freq, freq, sizeof(freq));
+      }
+    } else {
+      GtkWidget *error_dialog = gtk_message_dialog_new(GTK_WINDOW(window),
+						       GTK_DIALOG_DESTROY_WITH_PARENT,
+						       GTK_MESSAGE_ERROR,
+						       GTK_BUTTONS_CLOSE,
+						       "Error reading “%s”",
+						       filename);
+      gtk_dialog_run(GTK_DIALOG(error_dialog));
+      gtk_widget_destroy (error_dialog);
+    }
+    g_free(filename);
+  }
+  gtk_widget_destroy (dialog);
+}
+
+static void randomize(void) {
+  FOR(s, num_stages) {
+    FOR(i, 128) {
+      if (stages[s].cc_adjustment[i]) {
+	gtk_adjustment_set_value(stages[s].cc_adjustment[i], rand()%128);
+      }
+    }
+  }
+}
+
+static const struct plugin_entry* find_plugin(const char* id) {
+  FOR(i, NUM_PLUGINS) if (!strcmp(plugins[i].id, id)) return &plugins[i];
+  return NULL;
+}
+
+static void list_plugins(void) {
+  FOR(i, NUM_PLUGINS) printf("%-20s %s\n", plugins[i].id, *plugins[i].name);
+}
+
+static void usage(void) {
+  fprintf(stderr,
+	  "Usage: %s [--name CLIENT] [--threads N] [--stats FILE] [--realtime] [--bus PLUGIN,...] PLUGIN... [/ PLUGIN...]...\n"
+	  "       %s --list\n",
+	  program_name, program_name);
+}
+
+static void add_stage(const char* id, int lane) {
+  CHECK(num_stages < MAX_STAGES, "too many stages");
+  const struct plugin_entry* plugin = find_plugin(id);
+  if (!plugin) {
+    fprintf(stderr, "Error: unknown plugin %s (see --list)\n", id);
+    exit(1);
+  }
+  stages[num_stages].plugin = plugin;
+  stages[num_stages].lane = lane;
+  num_stages++;
+}
+
+static void parse_options(int argc, char** argv) {
+  program_name = argv[0];
+  while (1) {
+    int option_index = 0;
+    static struct option options[] = {
+      JACK_HOST_LONG_OPTIONS,
+      { "name", required_argument, NULL, 'n' },
+      { "threads", required_argument, NULL, 't' },
+      { "bus", required_argument, NULL, 'b' },
+      { "list", no_argument, NULL, 'l' },
+      { NULL, 0, NULL, 0 },
+    };
+    int c = getopt_long(argc, argv, "n:t:b:l", options, &option_index);
+    if (c == -1) break;
+    if (jack_host_parse_option(c)) continue;
+    switch (c) {
+    case 'n':
+      option_name = optarg;
+      break;
+    case 't':
+      option_threads = atoi(optarg);
+      CHECK(option_threads >= 1 && option_threads <= GRAPH_MAX_THREADS, "--threads must be between 1 and 32");
+      break;
+    case 'b':
+      option_bus = optarg;
+      break;
+    case 'l':
+      list_plugins();
+      exit(0);
+    case '?':
+      usage();
+      exit(1);
+    }
+  }
+  if (optind == argc) {
+    usage();
+    exit(1);
+  }
+  num_lanes = 1;
+  for (int i = optind; i < argc; i++) {
+    if (!strcmp(argv[i], "/")) {
+      if (num_stages > 0 && stages[num_stages - 1].lane == num_lanes - 1) num_lanes++;
+      continue;
+    }
+    CHECK(num_lanes <= MAX_LANES, "too many lanes");
+    add_stage(argv[i], num_lanes - 1);
+  }
+  if (num_stages > 0 && stages[num_stages - 1].lane != num_lanes - 1) num_lanes--;
+  CHECK(num_stages > 0, "no plugins given");
+  bus_start = num_stages;
+  if (option_bus) {
+    char* list = strdup(option_bus);
+    char* save_ptr = NULL;
+    for (char* id = strtok_r(list, ",", &save_ptr); id; id = strtok_r(NULL, ",", &save_ptr)) add_stage(id, -1);
+    free(list);
+  }
+}
+
+static void build_window(void) {
+  char title[256] = "mjack chain:";
+  FOR(s, num_stages) {
+    const char* separator = s == 0 ? " " : s == bus_start ? " => " : is_lane_start(s) ? " | " : " > ";
+    strncat(title, separator, sizeof(title) - strlen(title) - 1);
+    strncat(title, *stages[s].plugin->name, sizeof(title) - strlen(title) - 1);
+  }
+  window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  g_signal_connect_swapped(G_OBJECT(window), "destroy",
+                           G_CALLBACK(gtk_main_quit), NULL);
+  gtk_window_set_title(GTK_WINDOW(window), title);
+  gtk_window_set_default_size(GTK_WINDOW(window), 300, 200);
+  GtkWidget* main_box = gtk_vbox_new(FALSE, 0);
+  gtk_container_add(GTK_CONTAINER(window), main_box);
+  GtkWidget *load_scale_button = gtk_button_new_with_label("Load Scale");
+  gtk_signal_connect(GTK_OBJECT(load_scale_button), "clicked",
+		     GTK_SIGNAL_FUNC(load_scale), (gpointer) NULL);
+  gtk_container_add(GTK_CONTAINER(main_box), load_scale_button);
+  gtk_widget_show(load_scale_button);
+  GtkWidget *randomize_button = gtk_button_new_with_label("Randomize");
+  gtk_signal_connect(GTK_OBJECT(randomize_button), "clicked",
+		     GTK_SIGNAL_FUNC(randomize), (gpointer) NULL);
+  gtk_container_add(GTK_CONTAINER(main_box), randomize_button);
+  gtk_widget_show(randomize_button);
+  stages_box = gtk_hbox_new(FALSE, 0);
+  gtk_container_add(GTK_CONTAINER(main_box), stages_box);
+  gtk_widget_show(stages_box);
+  gtk_widget_show(main_box);
+  FOR(s, num_stages) {
+    char label[128];
+    if (stages[s].lane < 0) {
+      snprintf(label, sizeof(label), "bus: %s", *stages[s].plugin->name);
+    } else if (num_lanes > 1) {
+      snprintf(label, sizeof(label), "%d: %s", stages[s].lane + 1, *stages[s].plugin->name);
+    } else {
+      snprintf(label, sizeof(label), "%s", *stages[s].plugin->name);
+    }
+    GtkWidget* frame = gtk_frame_new(label);
+    stages[s].sliders_box = gtk_vbox_new(FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(frame), stages[s].sliders_box);
+    gtk_widget_show(stages[s].sliders_box);
+    gtk_box_pack_start(GTK_BOX(stages_box), frame, FALSE, FALSE, FALSE);
+    gtk_widget_show(frame);
+  }
+}
+
+static void init_stages(void) {
+  double sample_rate = jack_get_sample_rate(jack_client);
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    // Synths keep their state in file-level globals and leave
+    // instance->plugin unset; a second copy would share that state.
+    FOR(t, s) {
+      if (stages[t].plugin == st->plugin && !stages[t].instance.plugin) {
+	fprintf(stderr, "Error: %s can only appear once in a chain\n", st->plugin->id);
+	exit(1);
+      }
+    }
+    FOR(i, 128) {
+      st->instance.cents[i] = (i - 69.0) * 100.0;
+      st->instance.freq[i] = 440 * pow(2.0, st->instance.cents[i] / 1200.0);
+    }
+    st->instance.wrapper = st;
+    st->cc_ring = jack_host_ring(CC_RING_SIZE);
+    st->cc_changed_ring = jack_host_ring(CC_RING_SIZE);
+    driver_init(&st->driver, jack_midi_count, jack_midi_get, st->plugin->process);
+    st->plugin->init(&st->instance, sample_rate);
+  }
+  wire_stages();
+
+  // With several lanes, JACK port names get the lane number as a prefix.
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    char name[128];
+    if (is_lane_start(s)) {
+      FOR(i, st->num_inputs) {
+	if (num_lanes > 1) snprintf(name, sizeof(name), "%d %s", st->lane + 1, st->input_name[i]);
+	else snprintf(name, sizeof(name), "%s", st->input_name[i]);
+	st->jack_input[i] = jack_port_register(jack_client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+	CHECK(st->jack_input[i], "jack_port_register");
+      }
+    }
+    if (has_jack_outputs(s)) {
+      FOR(i, st->num_outputs) {
+	if (num_lanes > 1 && st->lane >= 0) snprintf(name, sizeof(name), "%d %s", st->lane + 1, st->output_name[i]);
+	else snprintf(name, sizeof(name), "%s", st->output_name[i]);
+	st->jack_output[i] = jack_port_register(jack_client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+	CHECK(st->jack_output[i], "jack_port_register");
+      }
+    }
+  }
+  jack_midi_input = jack_port_register(jack_client, "midi in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+  CHECK(jack_midi_input, "jack_port_register");
+}
+
+// One graph node per stage: each lane is a chain of nodes, and every lane
+// end feeds the first bus stage.
+static void build_graph(void) {
+  int node[MAX_STAGES];
+  FOR(s, num_stages) node[s] = graph_add_node(graph, run_stage, &stages[s]);
+  FOR(s, num_stages) {
+    if (s > 0 && !is_lane_start(s) && s != bus_start) graph_add_edge(graph, node[s - 1], node[s]);
+    if (bus_start < num_stages && is_lane_end(s)) graph_add_edge(graph, node[s], node[bus_start]);
+  }
+}
+
+static void destroy_stages(void) {
+  FOR(s, num_stages) {
+    struct stage* st = &stages[s];
+    st->plugin->destroy(&st->instance);
+    FOR(o, st->num_outputs) free(st->output_buf[o]);
+    FOR(i, st->num_inputs) free(st->mix_buf[i]);
+    jack_ringbuffer_free(st->cc_ring);
+    jack_ringbuffer_free(st->cc_changed_ring);
+  }
+}
+
+int main(int argc, char** argv) {
+  gtk_init(&argc, &argv);
+  parse_options(argc, argv);
+  build_window();
+
+  jack_client = jack_client_open(option_name, JackSessionID, &jack_status, option_uuid);
+  CHECK(jack_client, "jack_client_open");
+  CHECK(!jack_status, "jack_client_open");
+  CHECK(!jack_set_session_callback(jack_client, session_cb, NULL), "jack_set_session_callback");
+  CHECK(!jack_set_process_callback(jack_client, process_cb, NULL), "jack_set_process_callback");
+  CHECK(!jack_set_xrun_callback(jack_client, xrun_cb, NULL), "jack_set_xrun_callback");
+  signal(SIGUSR1, sigusr1_handler);
+  g_timeout_add(STATS_POLL_MS, check_stats_request, NULL);
+  g_timeout_add(SLIDER_INTERVAL_MS, update_sliders, NULL);
+
+  if (option_realtime) realtime_lock_memory();
+  init_stages();
+  graph = graph_new(option_threads, jack_client_real_time_priority(jack_client));
+  build_graph();
+  graph_start(graph);
+
+  gtk_widget_show(window);
+  if (option_dir) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/state.json", option_dir);
+    load(filename);
+  }
+  CHECK(!jack_activate(jack_client), "jack_activate");
+  if (option_realtime) realtime_check_sched(jack_client_thread_id(jack_client), "process thread");
+  gtk_main();
+  jack_deactivate(jack_client);
+  if (option_stats) report_stats();
+  jack_client_close(jack_client);
+  jack_client = NULL;
+  graph_free(graph);
+  destroy_stages();
+  return 0;
+}
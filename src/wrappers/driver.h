@@ -0,0 +1,168 @@
+// Sample-accurate MIDI CC handling shared by the wrappers.
+//
+// driver_process runs the plugin once per stretch between the CC messages of
+// a MIDI control stream, writing each CC into instance->wrapper_cc exactly on
+// its frame. The plugin's audio pointers are advanced for every stretch, and
+// its MIDI inputs are replaced by views that only show the events of the
+// current stretch, with times relative to its start. Plugins therefore never
+// handle 0xB0 messages themselves.
+//
+// Usage from a wrapper:
+//
+//   wrapper_add_audio_input/output -> driver_add_audio(&driver, buf, is_output)
+//   wrapper_add_midi_input         -> driver_add_midi(&driver, buf)
+//   wrapper_get_num_midi_events    -> driver_midi_view_count(buf)
+//   wrapper_get_midi_event         -> driver_midi_view_get(buf, i)
+//
+// and per block: point the audio buffers at the block as before, call
+// driver_set_midi for every MIDI input, then driver_process.
+//
+// raw_count and raw_get read the wrapper's own MIDI buffers. The control
+// stream is one of those: by convention the plugin's first MIDI input, or a
+// separate "control in" port for plugins without one.
+//
+// Stretches longer than instance->plugin_block_size are further split on that
+// grid, so a plugin asking for 64 frames sees aligned blocks of 64 except
+// where a CC lands inside one.
+//
+// Plugins that set plugin_tail sleep through silence (tail.h): the CCs of a
+// block are still applied, the outputs are zeroed and the plugin is not run.
+//
+// driver_process is the audio thread's whole stay in plugin code, so it is
+// what RTCHECK_ENTER/RTCHECK_LEAVE bracket (rtcheck.h).
+
+#define DRIVER_MAX_PORTS 64
+
+struct driver_midi_view {
+  struct driver* driver;
+  void* raw;
+  int first;
+  int count;
+  int offset;
+};
+
+struct driver {
+  int (*raw_count)(void* raw);
+  struct midi_event (*raw_get)(void* raw, int i);
+  void (*process)(struct instance* instance, int nframes);
+  int num_audio;
+  float** audio[DRIVER_MAX_PORTS];
+  bool audio_is_output[DRIVER_MAX_PORTS];
+  int num_midi;
+  void** midi[DRIVER_MAX_PORTS];
+  struct driver_midi_view view[DRIVER_MAX_PORTS];
+  // Bit n of cc_changed is set when cc n was changed by the control stream.
+  // Wrappers with a GUI clear it once they have passed the change on.
+  uint64_t cc_changed[2];
+};
+
+static inline void driver_init(struct driver* d,
+			       int (*raw_count)(void* raw),
+			       struct midi_event (*raw_get)(void* raw, int i),
+			       void (*process)(struct instance* instance, int nframes)) {
+  memset(d, 0, sizeof(*d));
+  d->raw_count = raw_count;
+  d->raw_get = raw_get;
+  d->process = process;
+}
+
+static inline void driver_add_audio(struct driver* d, float** buf, bool is_output) {
+  CHECK(d->num_audio < DRIVER_MAX_PORTS, "too many audio ports");
+  d->audio_is_output[d->num_audio] = is_output;
+  d->audio[d->num_audio++] = buf;
+}
+
+static inline void driver_add_midi(struct driver* d, void** buf) {
+  CHECK(d->num_midi < DRIVER_MAX_PORTS, "too many midi ports");
+  d->view[d->num_midi].driver = d;
+  d->midi[d->num_midi++] = buf;
+}
+
+static inline void driver_set_midi(struct driver* d, int m, void* raw) {
+  d->view[m].raw = raw;
+}
+
+static inline int driver_midi_view_count(void* buf) {
+  return ((struct driver_midi_view*) buf)->count;
+}
+
+static inline struct midi_event driver_midi_view_get(void* buf, int i) {
+  struct driver_midi_view* view = buf;
+  struct midi_event e = view->driver->raw_get(view->raw, view->first + i);
+  e.time -= view->offset;
+  return e;
+}
+
+static inline bool driver_is_cc(const struct midi_event* e) {
+  return e->size == 3 && (e->buffer[0] & 0xf0) == 0xb0;
+}
+
+// Runs frames [start, end) of the block. The audio pointers are left
+// advanced; driver_process puts them back.
+static inline void driver_run(struct driver* d, struct instance* instance, float** base, int* cursor, int start, int end) {
+  FOR(a, d->num_audio) *d->audio[a] = base[a] + start;
+  FOR(m, d->num_midi) {
+    struct driver_midi_view* view = &d->view[m];
+    int n = view->raw ? d->raw_count(view->raw) : 0;
+    view->first = cursor[m];
+    while (cursor[m] < n && d->raw_get(view->raw, cursor[m]).time < end) cursor[m]++;
+    view->count = cursor[m] - view->first;
+    view->offset = start;
+    *d->midi[m] = view;
+  }
+  wrapper_cc_dispatch(instance);
+  d->process(instance, end - start);
+}
+
+static inline void driver_run_blocked(struct driver* d, struct instance* instance, float** base, int* cursor, int start, int end) {
+  int size = instance->plugin_block_size;
+  if (size <= 0) {
+    driver_run(d, instance, base, cursor, start, end);
+    return;
+  }
+  while (start < end) {
+    int next = (start / size + 1) * size;
+    if (next > end) next = end;
+    driver_run(d, instance, base, cursor, start, next);
+    start = next;
+  }
+}
+
+static inline bool driver_silent(struct driver* d, float** base, int nframes, bool outputs) {
+  FOR(a, d->num_audio) {
+    if (d->audio_is_output[a] == outputs && tail_peak(base[a], nframes) >= TAIL_SILENCE) return false;
+  }
+  return true;
+}
+
+static inline void driver_process(struct driver* d, struct instance* instance, void* control, int nframes) {
+  RTCHECK_ENTER("driver_process");
+  float* base[DRIVER_MAX_PORTS];
+  int cursor[DRIVER_MAX_PORTS] = { 0 };
+  FOR(a, d->num_audio) base[a] = *d->audio[a];
+  bool silent = instance->plugin_tail && driver_silent(d, base, nframes, false);
+  if (!silent) instance->wrapper_sleeping = 0;
+  bool sleeping = instance->wrapper_sleeping;
+  int pos = 0;
+  int num_events = control ? d->raw_count(control) : 0;
+  FOR(e, num_events) {
+    struct midi_event event = d->raw_get(control, e);
+    if (!driver_is_cc(&event)) continue;
+    int t = event.time < pos ? pos : event.time > nframes ? nframes : event.time;
+    if (t > pos) {
+      if (!sleeping) driver_run_blocked(d, instance, base, cursor, pos, t);
+      pos = t;
+    }
+    int cc = event.buffer[1] & 0x7f;
+    wrapper_set_cc(instance, cc, event.buffer[2] & 0x7f);
+    d->cc_changed[cc >> 6] |= (uint64_t) 1 << (cc & 63);
+  }
+  if (sleeping) {
+    FOR(a, d->num_audio) if (d->audio_is_output[a]) memset(base[a], 0, nframes * sizeof(float));
+  } else {
+    if (pos < nframes) driver_run_blocked(d, instance, base, cursor, pos, nframes);
+    if (instance->plugin_tail) tail_update(instance, silent, silent && driver_silent(d, base, nframes, true), nframes);
+  }
+  FOR(a, d->num_audio) *d->audio[a] = base[a];
+  RTCHECK_LEAVE();
+}
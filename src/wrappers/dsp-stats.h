@@ -0,0 +1,117 @@
+// DSP load statistics for the JACK wrappers.
+//
+// The process thread calls dsp_stats_record once per block with the time the
+// plugin took, and the xrun callback calls dsp_stats_xrun. Every field has a
+// single writer and is only touched with relaxed atomics, so other threads
+// may read the statistics at any time without locking, e.g. to print them
+// from a GUI timer or after SIGUSR1.
+//
+// Load is the plugin's wall time as a fraction of the block's period,
+// nframes / sample rate. It is kept as a histogram with a resolution of 0.5%
+// of the period, from which the percentiles are read. Cycles come from the
+// CPU's time stamp counter where there is one, and are 0 elsewhere.
+//
+// An xrun that follows a block which overran its period was most likely
+// caused by the plugin; the others happened somewhere else in the graph.
+
+#define DSP_STATS_BUCKETS 256 // the last one also holds everything above 128%
+#define DSP_STATS_BUCKET_LOAD 0.005
+#define DSP_STATS_LOAD_SCALE 10000 // max_load is in units of 1/10000 period
+
+struct dsp_stats {
+  uint64_t count[DSP_STATS_BUCKETS];
+  uint64_t blocks;
+  uint64_t overruns; // blocks that took longer than their period
+  uint64_t max_usecs;
+  uint64_t max_cycles;
+  uint32_t max_load;
+  uint32_t period_usecs; // of the last block
+  int last_overran;
+  // Written by the xrun callback.
+  uint64_t xruns;
+  uint64_t xruns_after_overrun;
+};
+
+static inline uint64_t dsp_stats_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  return 0;
+#endif
+}
+
+// Only the owning thread writes a field, so a load and a store will do.
+static inline void dsp_stats_add(uint64_t* p, uint64_t n) {
+  __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void dsp_stats_record(struct dsp_stats* s, uint64_t usecs, uint64_t cycles, double period_usecs) {
+  double load = usecs / period_usecs;
+  int b = (int) (load / DSP_STATS_BUCKET_LOAD);
+  if (b >= DSP_STATS_BUCKETS) b = DSP_STATS_BUCKETS - 1;
+  dsp_stats_add(&s->count[b], 1);
+  dsp_stats_add(&s->blocks, 1);
+  if (load > 1) dsp_stats_add(&s->overruns, 1);
+  __atomic_store_n(&s->last_overran, load > 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->period_usecs, (uint32_t) period_usecs, __ATOMIC_RELAXED);
+  if (usecs > s->max_usecs) __atomic_store_n(&s->max_usecs, usecs, __ATOMIC_RELAXED);
+  if (cycles > s->max_cycles) __atomic_store_n(&s->max_cycles, cycles, __ATOMIC_RELAXED);
+  uint32_t load_scaled = load * DSP_STATS_LOAD_SCALE;
+  if (load_scaled > s->max_load) __atomic_store_n(&s->max_load, load_scaled, __ATOMIC_RELAXED);
+}
+
+static inline void dsp_stats_xrun(struct dsp_stats* s) {
+  dsp_stats_add(&s->xruns, 1);
+  if (__atomic_load_n(&s->last_overran, __ATOMIC_RELAXED)) dsp_stats_add(&s->xruns_after_overrun, 1);
+}
+
+// Upper edge of the bucket holding the p-quantile, as a fraction of the period.
+static inline double dsp_stats_percentile(const struct dsp_stats* s, double p) {
+  uint64_t counts[DSP_STATS_BUCKETS];
+  uint64_t total = 0;
+  FOR(b, DSP_STATS_BUCKETS) total += counts[b] = __atomic_load_n(&s->count[b], __ATOMIC_RELAXED);
+  if (!total) return 0;
+  uint64_t seen = 0;
+  FOR(b, DSP_STATS_BUCKETS) {
+    seen += counts[b];
+    if (seen >= p * total) return (b + 1) * DSP_STATS_BUCKET_LOAD;
+  }
+  return DSP_STATS_BUCKETS * DSP_STATS_BUCKET_LOAD;
+}
+
+static inline double dsp_stats_max_load(const struct dsp_stats* s) {
+  return (double) __atomic_load_n(&s->max_load, __ATOMIC_RELAXED) / DSP_STATS_LOAD_SCALE;
+}
+
+static inline void dsp_stats_print(FILE* f, const char* name, const struct dsp_stats* s) {
+  fprintf(f, "%s: %llu blocks of %u us, load p50 %.1f%% p99 %.1f%% max %.1f%%, "
+	  "max %llu us %llu cycles, %llu overruns, %llu xruns (%llu after an overrun)\n",
+	  name,
+	  (unsigned long long) __atomic_load_n(&s->blocks, __ATOMIC_RELAXED),
+	  __atomic_load_n(&s->period_usecs, __ATOMIC_RELAXED),
+	  100 * dsp_stats_percentile(s, 0.5),
+	  100 * dsp_stats_percentile(s, 0.99),
+	  100 * dsp_stats_max_load(s),
+	  (unsigned long long) __atomic_load_n(&s->max_usecs, __ATOMIC_RELAXED),
+	  (unsigned long long) __atomic_load_n(&s->max_cycles, __ATOMIC_RELAXED),
+	  (unsigned long long) __atomic_load_n(&s->overruns, __ATOMIC_RELAXED),
+	  (unsigned long long) __atomic_load_n(&s->xruns, __ATOMIC_RELAXED),
+	  (unsigned long long) __atomic_load_n(&s->xruns_after_overrun, __ATOMIC_RELAXED));
+}
+
+// Reports go to FILE, appended, or to stdout without --stats.
+static inline FILE* dsp_stats_open(const char* filename) {
+  if (!filename) return stdout;
+  FILE* f = fopen(filename, "a");
+  if (!f) fprintf(stderr, "Warning: could not open %s, printing stats to stdout\n", filename);
+  return f ? f : stdout;
+}
+
+static inline void dsp_stats_close(FILE* f) {
+  if (f == stdout) fflush(f);
+  else fclose(f);
+}
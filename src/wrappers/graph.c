@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include "wrapper.h"
+#include "graph.h"
+
+#define MAX_DEPENDENTS 64
+#define CACHE_LINE 64
+
+struct node {
+  graph_fn fn;
+  void* arg;
+  int num_dependents;
+  int dependents[MAX_DEPENDENTS];
+  int num_dependencies;
+  int pending;
+};
+
+// Chase-Lev work-stealing deque. The owner pushes and pops at the bottom,
+// thieves take from the top. A cycle never holds more than GRAPH_MAX_NODES
+// entries, so the buffer does not need to grow.
+struct deque {
+  long top __attribute__((aligned(CACHE_LINE)));
+  long bottom __attribute__((aligned(CACHE_LINE)));
+  int buf[GRAPH_MAX_NODES];
+};
+
+struct worker {
+  struct graph* graph;
+  int index;
+  pthread_t thread;
+  sem_t wake;
+  struct deque deque;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct graph {
+  int num_nodes;
+  struct node nodes[GRAPH_MAX_NODES];
+  int order[GRAPH_MAX_NODES];
+  int num_roots;
+  int roots[GRAPH_MAX_NODES];
+  int num_threads;
+  int rt_priority;
+  int running;
+  int nframes;
+  int remaining __attribute__((aligned(CACHE_LINE)));
+  struct worker workers[GRAPH_MAX_THREADS];
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static void deque_push(struct deque* d, int n) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->buf[b & (GRAPH_MAX_NODES - 1)], n, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static int deque_pop(struct deque* d) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  if (t > b) {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  int n = __atomic_load_n(&d->buf[b & (GRAPH_MAX_NODES - 1)], __ATOMIC_RELAXED);
+  if (t == b) {
+    // Last entry: race the thieves for it.
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) n = -1;
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return n;
+}
+
+static int deque_steal(struct deque* d) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b) return -1;
+  int n = __atomic_load_n(&d->buf[t & (GRAPH_MAX_NODES - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return -1;
+  return n;
+}
+
+static void run_node(struct graph* g, struct worker* w, int n) {
+  struct node* node = &g->nodes[n];
+  node->fn(node->arg, g->nframes);
+  FOR(i, node->num_dependents) {
+    int d = node->dependents[i];
+    if (__atomic_sub_fetch(&g->nodes[d].pending, 1, __ATOMIC_ACQ_REL) == 0) deque_push(&w->deque, d);
+  }
+  __atomic_sub_fetch(&g->remaining, 1, __ATOMIC_RELEASE);
+}
+
+// Runs nodes until the whole cycle is done, stealing from the other workers
+// when the own deque is empty.
+static void work(struct graph* g, struct worker* w) {
+  int victim = w->index;
+  while (__atomic_load_n(&g->remaining, __ATOMIC_ACQUIRE) > 0) {
+    int n = deque_pop(&w->deque);
+    if (n < 0) {
+      FOR(i, g->num_threads) {
+	victim = victim + 1 == g->num_threads ? 0 : victim + 1;
+	if (victim == w->index) continue;
+	n = deque_steal(&g->workers[victim].deque);
+	if (n >= 0) break;
+      }
+    }
+    if (n < 0) {
+      cpu_relax();
+      continue;
+    }
+    run_node(g, w, n);
+  }
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  struct graph* g = w->graph;
+  while (1) {
+    while (sem_wait(&w->wake) && errno == EINTR);
+    if (!__atomic_load_n(&g->running, __ATOMIC_ACQUIRE)) break;
+    work(g, w);
+  }
+  return NULL;
+}
+
+struct graph* graph_new(int num_threads, int rt_priority) {
+  CHECK(num_threads >= 1 && num_threads <= GRAPH_MAX_THREADS, "thread count out of range");
+  struct graph* g = memalign(CACHE_LINE, sizeof(struct graph));
+  CHECK(g, "out of memory");
+  memset(g, 0, sizeof(struct graph));
+  g->num_threads = num_threads;
+  g->rt_priority = rt_priority;
+  if (num_threads > sysconf(_SC_NPROCESSORS_ONLN)) {
+    fprintf(stderr, "Warning: %d graph threads but only %ld cores; workers will spin against each other\n",
+	    num_threads, sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  return g;
+}
+
+int graph_add_node(struct graph* g, graph_fn fn, void* arg) {
+  CHECK(g->num_nodes < GRAPH_MAX_NODES, "too many graph nodes");
+  int n = g->num_nodes++;
+  g->nodes[n].fn = fn;
+  g->nodes[n].arg = arg;
+  return n;
+}
+
+void graph_add_edge(struct graph* g, int from, int to) {
+  struct node* node = &g->nodes[from];
+  CHECK(node->num_dependents < MAX_DEPENDENTS, "too many graph edges");
+  node->dependents[node->num_dependents++] = to;
+  g->nodes[to].num_dependencies++;
+}
+
+static void spawn_worker(struct graph* g, struct worker* w) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  if (g->rt_priority > 0) {
+    struct sched_param param = { .sched_priority = g->rt_priority };
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+  }
+  // Worker 0 is the caller of graph_run; pin the others to their own cores.
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cpus > 1) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(w->index % num_cpus, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+  int err = pthread_create(&w->thread, &attr, worker_main, w);
+  if (err == EPERM && g->rt_priority > 0) {
+    fprintf(stderr, "Warning: no permission for SCHED_FIFO, graph worker %d runs unprivileged\n", w->index);
+    pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+    err = pthread_create(&w->thread, &attr, worker_main, w);
+  }
+  CHECK(!err, "could not create graph worker thread");
+  pthread_attr_destroy(&attr);
+}
+
+void graph_start(struct graph* g) {
+  // Topological order for the single-threaded path, which also rejects cycles.
+  int pending[GRAPH_MAX_NODES];
+  int n = 0;
+  FOR(i, g->num_nodes) {
+    pending[i] = g->nodes[i].num_dependencies;
+    if (!pending[i]) g->roots[g->num_roots++] = i;
+  }
+  FOR(i, g->num_roots) g->order[n++] = g->roots[i];
+  FOR(i, n) {
+    struct node* node = &g->nodes[g->order[i]];
+    FOR(j, node->num_dependents) {
+      if (!--pending[node->dependents[j]]) g->order[n++] = node->dependents[j];
+    }
+  }
+  CHECK(n == g->num_nodes, "graph has a cycle");
+
+  g->running = 1;
+  FOR(i, g->num_threads) {
+    struct worker* w = &g->workers[i];
+    w->graph = g;
+    w->index = i;
+    CHECK(!sem_init(&w->wake, 0, 0), "sem_init");
+    if (i > 0) spawn_worker(g, w);
+  }
+}
+
+void graph_run(struct graph* g, int nframes) {
+  g->nframes = nframes;
+  if (g->num_threads == 1) {
+    FOR(i, g->num_nodes) {
+      struct node* node = &g->nodes[g->order[i]];
+      node->fn(node->arg, nframes);
+    }
+    return;
+  }
+  FOR(i, g->num_nodes) __atomic_store_n(&g->nodes[i].pending, g->nodes[i].num_dependencies, __ATOMIC_RELAXED);
+  __atomic_store_n(&g->remaining, g->num_nodes, __ATOMIC_RELEASE);
+  struct worker* self = &g->workers[0];
+  FOR(i, g->num_roots) deque_push(&self->deque, g->roots[i]);
+  for (int i = 1; i < g->num_threads; i++) sem_post(&g->workers[i].wake);
+  work(g, self);
+}
+
+void graph_free(struct graph* g) {
+  __atomic_store_n(&g->running, 0, __ATOMIC_RELEASE);
+  for (int i = 1; i < g->num_threads; i++) {
+    sem_post(&g->workers[i].wake);
+    pthread_join(g->workers[i].thread, NULL);
+  }
+  FOR(i, g->num_threads) sem_destroy(&g->workers[i].wake);
+  free(g);
+}
@@ -0,0 +1,17 @@
+// Dependency graph of processing callbacks, executed once per audio cycle by
+// the calling (realtime) thread plus a pool of pinned worker threads.
+// Independent nodes run in parallel; graph_run returns when all are done.
+
+#define GRAPH_MAX_NODES 256
+#define GRAPH_MAX_THREADS 32
+
+struct graph;
+
+typedef void (*graph_fn)(void* arg, int nframes);
+
+struct graph* graph_new(int num_threads, int rt_priority);
+int graph_add_node(struct graph* g, graph_fn fn, void* arg);
+void graph_add_edge(struct graph* g, int from, int to);
+void graph_start(struct graph* g);
+void graph_run(struct graph* g, int nframes);
+void graph_free(struct graph* g);
@@ -0,0 +1,343 @@
+// Headless JACK host: the jack-gtk wrapper without GTK. Parameters and status
+// are available over a UNIX-domain socket, one text command per line:
+//
+//   list                  all controls as "NAME VALUE"
+//   get NAME              one control; NAME is a persist name or cc number
+//   set NAME VALUE        change a control (applied at the next block)
+//   status                DSP and JACK load, xruns and peaks since last status
+//   stats                 DSP load percentiles and xruns since startup
+//   save FILE, load FILE  same JSON state files as the session handler
+//   quit                  shut down
+//
+// Every reply ends with a line "ok" or "error: ...". For example:
+//
+//   reverb-jack --socket /tmp/reverb.sock &
+//   echo "set wet 90" | socat - UNIX-CONNECT:/tmp/reverb.sock
+//
+// SIGUSR1 prints the stats line to stdout, or appends it to the --stats file.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "wrapper.h"
+#include "jack-plugin-host.h"
+
+#define POLL_INTERVAL_MS 50
+
+// Maxima since the last status command.
+static float status_peak[MAX_NUM_PORTS];
+static float status_dsp_load;
+
+// Session events and signals arrive on other threads; they are handed to the
+// main loop through this pipe, one message per write, so that session events
+// queue up until each has been answered.
+static int wake_pipe[2];
+enum wake_reason { WAKE_SESSION = 's', WAKE_QUIT = 'q', WAKE_STATS = 'u' };
+
+struct wake_message {
+  char reason;
+  jack_session_event_t* session_event;
+};
+
+static void wake(char reason, jack_session_event_t* session_event) {
+  struct wake_message msg = { reason, session_event };
+  while (write(wake_pipe[1], &msg, sizeof(msg)) < 0 && errno == EINTR);
+}
+
+static int find_cc(const char* name) {
+  FOR(i, 128) if (cc_persist_name[i] && !strcmp(cc_persist_name[i], name)) return i;
+  char* end;
+  long n = strtol(name, &end, 10);
+  if (*name && !*end && n >= 0 && n < 128 && cc_persist_name[n]) return n;
+  return -1;
+}
+
+void wrapper_add_cc(struct instance* _instance, int cc_number, const char* display_name, const char* persist_name, int default_value) {
+  jack_host_add_cc(cc_number, persist_name, default_value);
+}
+
+// JACK callbacks
+
+static void session_cb(jack_session_event_t *event, void *arg) {
+  wake(WAKE_SESSION, event);
+}
+
+static void shutdown_cb(void* arg) {
+  wake(WAKE_QUIT, NULL);
+}
+
+static void signal_handler(int sig) {
+  wake(sig == SIGUSR1 ? WAKE_STATS : WAKE_QUIT, NULL);
+}
+
+// Main loop
+
+static const char* option_name;
+static const char* option_socket;
+
+static void handle_session_event(jack_session_event_t* ev, bool* quit) {
+  char name[256], socket_path[448], args[768];
+  jack_host_quote(name, sizeof(name), option_name);
+  jack_host_quote(socket_path, sizeof(socket_path), option_socket);
+  snprintf(args, sizeof(args), " --name=%s --socket=%s", name, socket_path);
+  if (jack_host_session_reply(ev, jack_host_save, args)) *quit = true;
+}
+
+static void drain_telemetry(void) {
+  struct telemetry t;
+  while (jack_ringbuffer_read(telemetry_ring, (char*) &t, sizeof(t)) == sizeof(t)) {
+    FOR(i, jack_num_ports) status_peak[i] = fmaxf(status_peak[i], t.peak[i]);
+    status_dsp_load = fmaxf(status_dsp_load, t.dsp_load);
+    FOR(cc, 128) if (t.cc_changed[cc >> 6] >> (cc & 63) & 1) host_cc[cc] = t.cc[cc];
+  }
+}
+
+#define MAX_CLIENTS 16
+#define MAX_LINE 512
+
+struct client {
+  int fd;
+  int len;
+  char line[MAX_LINE];
+};
+
+static struct client clients[MAX_CLIENTS];
+static int num_clients;
+
+static void reply(int fd, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void reply(int fd, const char* fmt, ...) {
+  char buf[MAX_LINE];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (len >= (int) sizeof(buf)) len = sizeof(buf) - 1;
+  // Replies are short; a client that does not read them is its own problem.
+  if (send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno != EAGAIN) {
+    fprintf(stderr, "send: %s\n", strerror(errno));
+  }
+}
+
+static void report_status(int fd) {
+  drain_telemetry();
+  reply(fd, "dsp_load %.4f\n", status_dsp_load);
+  reply(fd, "jack_load %.4f\n", jack_cpu_load(jack_client) / 100);
+  reply(fd, "xruns %llu\n", (unsigned long long) __atomic_load_n(&dsp_stats.xruns, __ATOMIC_RELAXED));
+  FOR(i, jack_num_ports) {
+    if (!jack_port_is_audio[i]) continue;
+    if (status_peak[i] > 0) reply(fd, "peak %s %.1f\n", jack_port_short_name(jack_port[i]), 20 * log10(status_peak[i]));
+    else reply(fd, "peak %s -inf\n", jack_port_short_name(jack_port[i]));
+    status_peak[i] = 0;
+  }
+  status_dsp_load = 0;
+}
+
+static void handle_command(int fd, char* line, bool* quit) {
+  char* save_ptr = NULL;
+  const char* cmd = strtok_r(line, " \t\r", &save_ptr);
+  const char* arg1 = strtok_r(NULL, " \t\r", &save_ptr);
+  const char* arg2 = strtok_r(NULL, " \t\r", &save_ptr);
+  if (!cmd) return;
+  if (!strcmp(cmd, "list")) {
+    FOR(i, 128) if (cc_persist_name[i]) reply(fd, "%s %d\n", cc_persist_name[i], host_cc[i]);
+  } else if (!strcmp(cmd, "get") && arg1) {
+    int cc = find_cc(arg1);
+    if (cc < 0) { reply(fd, "error: no control %s\n", arg1); return; }
+    reply(fd, "%s %d\n", cc_persist_name[cc], host_cc[cc]);
+  } else if (!strcmp(cmd, "set") && arg1 && arg2) {
+    int cc = find_cc(arg1);
+    if (cc < 0) { reply(fd, "error: no control %s\n", arg1); return; }
+    char* end;
+    long value = strtol(arg2, &end, 10);
+    if (!*arg2 || *end || value < 0 || value > 127) { reply(fd, "error: value must be a number between 0 and 127\n"); return; }
+    if (!jack_host_send_cc(cc, value)) { reply(fd, "error: queue full\n"); return; }
+  } else if (!strcmp(cmd, "status")) {
+    report_status(fd);
+  } else if (!strcmp(cmd, "stats")) {
+    char text[MAX_LINE];
+    FILE* f = fmemopen(text, sizeof(text), "w");
+    CHECK(f, "fmemopen");
+    dsp_stats_print(f, jack_get_client_name(jack_client), &dsp_stats);
+    fclose(f);
+    reply(fd, "%s", text);
+  } else if (!strcmp(cmd, "save") && arg1) {
+    if (!jack_host_save(arg1)) { reply(fd, "error: could not save %s\n", arg1); return; }
+  } else if (!strcmp(cmd, "load") && arg1) {
+    if (!jack_host_load(arg1)) { reply(fd, "error: could not load %s\n", arg1); return; }
+  } else if (!strcmp(cmd, "quit")) {
+    *quit = true;
+  } else {
+    reply(fd, "error: unknown command %s\n", cmd);
+    return;
+  }
+  reply(fd, "ok\n");
+}
+
+static void close_client(int c) {
+  close(clients[c].fd);
+  clients[c] = clients[--num_clients];
+}
+
+// Returns false when the client has gone away.
+static bool read_client(struct client* cl, bool* quit) {
+  int n = read(cl->fd, cl->line + cl->len, sizeof(cl->line) - 1 - cl->len);
+  if (n <= 0) return n < 0 && errno == EINTR;
+  cl->len += n;
+  char* start = cl->line;
+  char* newline;
+  while ((newline = memchr(start, '\n', cl->line + cl->len - start))) {
+    *newline = 0;
+    handle_command(cl->fd, start, quit);
+    start = newline + 1;
+  }
+  cl->len -= start - cl->line;
+  memmove(cl->line, start, cl->len);
+  if (cl->len == sizeof(cl->line) - 1) {
+    reply(cl->fd, "error: line too long\n");
+    return false;
+  }
+  return true;
+}
+
+static int open_socket(const char* path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  CHECK(strlen(path) < sizeof(addr.sun_path), "socket path too long");
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  CHECK(fd >= 0, "socket");
+  unlink(path);
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "Error: could not bind %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  CHECK(!listen(fd, 4), "listen");
+  return fd;
+}
+
+static void main_loop(int listen_fd) {
+  bool quit = false;
+  while (!quit) {
+    struct pollfd fds[2 + MAX_CLIENTS];
+    fds[0] = (struct pollfd) { .fd = wake_pipe[0], .events = POLLIN };
+    fds[1] = (struct pollfd) { .fd = listen_fd, .events = POLLIN };
+    FOR(c, num_clients) fds[2 + c] = (struct pollfd) { .fd = clients[c].fd, .events = POLLIN };
+    int n = poll(fds, 2 + num_clients, POLL_INTERVAL_MS);
+    if (n < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+    drain_telemetry();
+    if (n <= 0) continue;
+    if (fds[0].revents & POLLIN) {
+      // All of them, so that every session event is answered before quitting
+      struct wake_message msg;
+      while (read(wake_pipe[0], &msg, sizeof(msg)) == sizeof(msg)) {
+	if (msg.reason == WAKE_SESSION) handle_session_event(msg.session_event, &quit);
+	if (msg.reason == WAKE_QUIT) quit = true;
+	if (msg.reason == WAKE_STATS) jack_host_report_stats();
+      }
+    }
+    // Walk backwards since close_client moves the last client into the gap.
+    for (int c = num_clients - 1; c >= 0; c--) {
+      if (fds[2 + c].revents & (POLLIN | POLLHUP | POLLERR)) {
+	if (!read_client(&clients[c], &quit)) close_client(c);
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (fd >= 0 && num_clients < MAX_CLIENTS) {
+	clients[num_clients++] = (struct client) { .fd = fd };
+      } else if (fd >= 0) {
+	reply(fd, "error: too many clients\n");
+	close(fd);
+      }
+    }
+  }
+  FOR(c, num_clients) close(clients[c].fd);
+  num_clients = 0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: %s [--name CLIENT] [--socket PATH] [--stats FILE] [--realtime]\n", program_name);
+}
+
+static void parse_options(int argc, char** argv) {
+  program_name = argv[0];
+  option_name = plugin_persistence_name;
+  while (1) {
+    int option_index = 0;
+    static struct option options[] = {
+      JACK_HOST_LONG_OPTIONS,
+      { "name", required_argument, NULL, 'n' },
+      { "socket", required_argument, NULL, 's' },
+      { "help", no_argument, NULL, 'h' },
+      { NULL, 0, NULL, 0 },
+    };
+    int c = getopt_long(argc, argv, "n:s:h", options, &option_index);
+    if (c == -1) break;
+    if (jack_host_parse_option(c)) continue;
+    switch (c) {
+    case 'n':
+      option_name = optarg;
+      break;
+    case 's':
+      option_socket = optarg;
+      break;
+    case 'h':
+      usage();
+      exit(0);
+    default:
+      usage();
+      exit(1);
+    }
+  }
+  if (optind < argc) {
+    fprintf(stderr, "unknown argument: %s\n", argv[optind]);
+    exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  parse_options(argc, argv);
+
+  CHECK(!pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK), "pipe");
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+  signal(SIGUSR1, signal_handler);
+  signal(SIGPIPE, SIG_IGN);
+
+  jack_host_open(option_name, session_cb);
+  jack_on_shutdown(jack_client, shutdown_cb, NULL);
+  if (option_realtime) realtime_lock_memory();
+  plugin_init(&instance, jack_get_sample_rate(jack_client));
+
+  // The socket is named after the JACK client, which may have been renamed.
+  char default_socket[256];
+  if (!option_socket) {
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    snprintf(default_socket, sizeof(default_socket), "%s/mjack-%s.sock", dir ? dir : "/tmp", jack_get_client_name(jack_client));
+    option_socket = default_socket;
+  }
+  int listen_fd = open_socket(option_socket);
+  fprintf(stderr, "listening on %s\n", option_socket);
+
+  jack_host_activate();
+  main_loop(listen_fd);
+  jack_host_close();
+  close(listen_fd);
+  unlink(option_socket);
+  plugin_destroy(&instance);
+  return 0;
+}
@@ -0,0 +1,200 @@
+// What every JACK host has in common (jack-plugin-host.h for one plugin,
+// chain-wrapper.c for several): the client, the command line options, CC
+// queues, MIDI access, state files and session replies.
+//
+// Once jack is running, an instance's wrapper_cc belongs to the thread that
+// runs it. The user interface keeps its own copy of the values and sends
+// changes through a ring with jack_host_queue_cc; the process callback applies
+// them with jack_host_apply_ccs at the first block boundary after their
+// timestamp.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <jack/jack.h>
+#include <jack/session.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+#include <json.h>
+#include "tail.h"
+#include "rtcheck.h"
+#include "driver.h"
+
+static jack_client_t* jack_client;
+static jack_status_t jack_status;
+
+static const char* program_name;
+static const char* option_uuid;
+static const char* option_dir;
+static const char* option_stats;
+static bool option_realtime;
+
+// Command line options of every JACK host, for getopt_long
+#define JACK_HOST_OPTION_SESSION_UUID 1001
+#define JACK_HOST_OPTION_SESSION_DIR 1002
+#define JACK_HOST_OPTION_STATS 1003
+#define JACK_HOST_OPTION_REALTIME 1004
+#define JACK_HOST_LONG_OPTIONS \
+  { "jack-session-uuid", required_argument, NULL, JACK_HOST_OPTION_SESSION_UUID }, \
+  { "jack-session-dir", required_argument, NULL, JACK_HOST_OPTION_SESSION_DIR }, \
+  { "stats", required_argument, NULL, JACK_HOST_OPTION_STATS }, \
+  { "realtime", no_argument, NULL, JACK_HOST_OPTION_REALTIME }
+
+// Returns false for options that are not in JACK_HOST_LONG_OPTIONS.
+static bool jack_host_parse_option(int c) {
+  switch (c) {
+  case JACK_HOST_OPTION_SESSION_UUID:
+    option_uuid = optarg;
+    return true;
+  case JACK_HOST_OPTION_SESSION_DIR:
+    fprintf(stderr, "option_dir=%s\n", optarg);
+    option_dir = optarg;
+    return true;
+  case JACK_HOST_OPTION_STATS:
+    option_stats = optarg;
+    return true;
+  case JACK_HOST_OPTION_REALTIME:
+    option_realtime = true;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// CC queues
+
+struct cc_event {
+  jack_nframes_t time;
+  unsigned char cc_number;
+  unsigned char value;
+};
+
+#define CC_RING_SIZE (256 * sizeof(struct cc_event))
+
+static inline jack_ringbuffer_t* jack_host_ring(size_t size) {
+  jack_ringbuffer_t* ring = jack_ringbuffer_create(size);
+  CHECK(ring, "jack_ringbuffer_create");
+  jack_ringbuffer_mlock(ring);
+  return ring;
+}
+
+// Returns false when the ring is full.
+static inline bool jack_host_queue_cc(jack_ringbuffer_t* ring, int cc_number, int value) {
+  struct cc_event ev = { jack_frame_time(jack_client), cc_number, value };
+  if (jack_ringbuffer_write_space(ring) < sizeof(ev)) return false;
+  jack_ringbuffer_write(ring, (const char*) &ev, sizeof(ev));
+  return true;
+}
+
+// Process thread: applies the changes due by block_start.
+static inline void jack_host_apply_ccs(jack_ringbuffer_t* ring, struct instance* instance, jack_nframes_t block_start) {
+  struct cc_event ev;
+  while (jack_ringbuffer_peek(ring, (char*) &ev, sizeof(ev)) == sizeof(ev)) {
+    if ((int32_t) (ev.time - block_start) > 0) break;
+    wrapper_set_cc(instance, ev.cc_number, ev.value);
+    jack_ringbuffer_read_advance(ring, sizeof(ev));
+  }
+}
+
+// MIDI
+
+int wrapper_get_num_midi_events(void *buf) {
+  return driver_midi_view_count(buf);
+}
+
+struct midi_event wrapper_get_midi_event(void *buf, int i) {
+  return driver_midi_view_get(buf, i);
+}
+
+static int jack_midi_count(void *buf) {
+  return jack_midi_get_event_count(buf);
+}
+
+static struct midi_event jack_midi_get(void *buf, int i) {
+  jack_midi_event_t event;
+  jack_midi_event_get(&event, buf, i);
+  return (struct midi_event) {
+    .time = event.time,
+    .size = event.size,
+    .buffer = event.buffer,
+  };
+}
+
+// State files
+
+// A "cc" object with the value of every control that has a persist name
+static struct json_object* jack_host_cc_object(const char* const* persist_name, const char* value) {
+  struct json_object* cc_obj = json_object_new_object();
+  FOR(i, 128) if (persist_name[i]) json_object_object_add(cc_obj, persist_name[i], json_object_new_int(value[i]));
+  return cc_obj;
+}
+
+// Reads a control from a "cc" object into *value.
+static bool jack_host_read_cc(struct json_object* cc_obj, int cc_number, const char* name, int* value) {
+  struct json_object *tmp = NULL;
+  if (!json_object_object_get_ex(cc_obj, name, &tmp) || !tmp) {
+    fprintf(stderr, "Could not load cc %i (%s)\n", cc_number, name);
+    return false;
+  }
+  *value = json_object_get_int(tmp);
+  return true;
+}
+
+// Writes and releases obj.
+static bool jack_host_write_state(const char* filename, struct json_object* obj) {
+  fprintf(stderr, "saving %s\n", filename);
+  bool ok = json_object_to_file((char*) filename, obj) == 0;
+  json_object_put(obj);
+  return ok;
+}
+
+// Returns NULL if the file cannot be read.
+static struct json_object* jack_host_read_state(const char* filename) {
+  fprintf(stderr, "loading %s\n", filename);
+  struct json_object* obj = json_object_from_file((char*) filename);
+  if (!obj) fprintf(stderr, "error while loading %s\n", filename);
+  return obj;
+}
+
+// Sessions
+
+// Quotes s for the shell that runs the session's command line, as in
+// 'it'\''s', truncating it to fit into size bytes.
+static inline void jack_host_quote(char* out, size_t size, const char* s) {
+  size_t n = 0;
+  out[n++] = '\'';
+  for (; *s && n + 6 <= size; s++) {
+    if (*s == '\'') {
+      memcpy(out + n, "'\\''", 4);
+      n += 4;
+    } else {
+      out[n++] = *s;
+    }
+  }
+  out[n++] = '\'';
+  out[n] = 0;
+}
+
+// Saves the state into the session directory and replies with the command
+// line that restores it, followed by extra_args. Returns whether the session
+// manager asked the client to quit.
+static bool jack_host_session_reply(jack_session_event_t* ev, bool (*save)(const char* filename), const char* extra_args) {
+  char filename[256];
+  char command[1024];
+
+  snprintf(filename, sizeof(filename), "%s/state.json", ev->session_dir);
+  snprintf(command, sizeof(command), "%s --jack-session-uuid=%s \"--jack-session-dir=${SESSION_DIR}\"%s",
+	   program_name, ev->client_uuid, extra_args);
+
+  save(filename);
+
+  ev->command_line = strdup(command);
+  jack_session_reply(jack_client, ev);
+
+  bool quit = ev->type == JackSessionSaveAndQuit;
+  jack_session_event_free(ev);
+  return quit;
+}
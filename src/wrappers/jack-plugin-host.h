@@ -0,0 +1,234 @@
+// The JACK side of a single-plugin host, shared by jack-gtk-wrapper.c and
+// jack-headless-wrapper.c: ports, the process callback, the CC and telemetry
+// rings, DSP statistics and state files, on top of jack-host.h. The wrappers
+// add their user interface, session handling and main loop.
+//
+// The user interface keeps its copy of the CCs in host_cc and sends changes
+// through cc_ring with jack_host_send_cc. Meter readings travel the other way
+// through telemetry_ring, one struct telemetry per block, along with the CCs
+// that MIDI changed in it.
+//
+//   jack_host_open(name, session_cb);
+//   if (option_realtime) realtime_lock_memory();
+//   plugin_init(&instance, jack_get_sample_rate(jack_client));
+//   jack_host_activate();
+//   ... main loop, reading telemetry_ring ...
+//   jack_host_close();
+//   plugin_destroy(&instance);
+
+#include <math.h>
+#include "jack-host.h"
+#include "dsp-stats.h"
+#include "realtime.h"
+
+static struct instance instance;
+
+#define MAX_NUM_PORTS 8
+static int jack_num_ports;
+static jack_port_t* jack_port[MAX_NUM_PORTS];
+static void** jack_buf[MAX_NUM_PORTS];
+static bool jack_port_is_audio[MAX_NUM_PORTS];
+static int jack_midi_index[MAX_NUM_PORTS]; // driver midi input, or -1
+// CCs come from the plugin's first MIDI input, or from this port if it has none.
+static jack_port_t* jack_control_port;
+
+static struct driver driver;
+
+static const char* cc_persist_name[128];
+
+struct telemetry {
+  float peak[MAX_NUM_PORTS];
+  float dsp_load;
+  // CCs changed by MIDI during this block, and their values.
+  uint64_t cc_changed[2];
+  char cc[128];
+};
+
+#define TELEMETRY_RING_SIZE (64 * sizeof(struct telemetry))
+
+static jack_ringbuffer_t* cc_ring;
+static jack_ringbuffer_t* telemetry_ring;
+static char host_cc[128];
+static struct dsp_stats dsp_stats;
+
+// Main thread side
+
+// Returns false, leaving host_cc alone, when cc_ring is full.
+static bool jack_host_send_cc(int cc_number, int value) {
+  if (!jack_host_queue_cc(cc_ring, cc_number, value)) return false;
+  host_cc[cc_number] = value;
+  return true;
+}
+
+// Called by the wrapper's wrapper_add_cc
+static void jack_host_add_cc(int cc_number, const char* persist_name, int default_value) {
+  wrapper_set_cc(&instance, cc_number, default_value);
+  host_cc[cc_number] = default_value;
+  cc_persist_name[cc_number] = persist_name;
+}
+
+static void jack_host_report_stats(void) {
+  FILE* f = dsp_stats_open(option_stats);
+  dsp_stats_print(f, jack_get_client_name(jack_client), &dsp_stats);
+  dsp_stats_close(f);
+}
+
+// State files
+
+static bool jack_host_save(const char* filename) {
+  struct json_object* obj = json_object_new_object();
+  json_object_object_add(obj, "info", json_object_new_string("state file for mjack reverb"));
+  json_object_object_add(obj, "cc", jack_host_cc_object(cc_persist_name, host_cc));
+  return jack_host_write_state(filename, obj);
+}
+
+static bool jack_host_load(const char* filename) {
+  struct json_object* obj = jack_host_read_state(filename);
+  if (!obj) return false;
+  struct json_object* cc_obj = NULL;
+  if (!json_object_object_get_ex(obj, "cc", &cc_obj) || !cc_obj) {
+    json_object_put(obj);
+    fprintf(stderr, "error while loading %s\n", filename);
+    return false;
+  }
+  FOR(i, 128) {
+    int value;
+    if (!cc_persist_name[i] || !jack_host_read_cc(cc_obj, i, cc_persist_name[i], &value)) continue;
+    if (jack_host_send_cc(i, value)) fprintf(stderr, "set cc %i to %i\n", i, value);
+    else fprintf(stderr, "cc queue full, dropping cc %i\n", i);
+  }
+  json_object_put(obj);
+  return true;
+}
+
+// Wrapper API
+
+static void add_port(const char* name, const char* type, unsigned long flags, void** buf) {
+  CHECK(jack_num_ports < MAX_NUM_PORTS, "too many ports");
+  int i = jack_num_ports++;
+  jack_port[i] = jack_port_register(jack_client, name, type, flags, 0);
+  CHECK(jack_port[i], "jack_port_register");
+  jack_buf[i] = buf;
+  jack_port_is_audio[i] = !strcmp(type, JACK_DEFAULT_AUDIO_TYPE);
+  if (jack_port_is_audio[i]) {
+    jack_midi_index[i] = -1;
+    driver_add_audio(&driver, (float**) buf, flags & JackPortIsOutput);
+  } else {
+    jack_midi_index[i] = driver.num_midi;
+    driver_add_midi(&driver, buf);
+  }
+}
+
+void wrapper_add_audio_input(struct instance* _instance, const char* name, float** buf) {
+  add_port(name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, (void**) buf);
+}
+
+void wrapper_add_audio_output(struct instance* _instance, const char* name, float** buf) {
+  add_port(name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, (void**) buf);
+}
+
+void wrapper_add_midi_input(struct instance* _instance, const char* name, void** buf) {
+  add_port(name, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, buf);
+}
+
+// JACK callbacks
+
+static void send_telemetry(jack_nframes_t nframes, jack_time_t dsp_usecs) {
+  struct telemetry t;
+  if (jack_ringbuffer_write_space(telemetry_ring) < sizeof(t)) return;
+  FOR(i, jack_num_ports) {
+    float peak = 0;
+    if (jack_port_is_audio[i]) {
+      const float* buf = *jack_buf[i];
+      FOR(j, (int) nframes) peak = fmaxf(peak, fabsf(buf[j]));
+    }
+    t.peak[i] = peak;
+  }
+  t.dsp_load = dsp_usecs * 1e-6 * jack_get_sample_rate(jack_client) / nframes;
+  t.cc_changed[0] = driver.cc_changed[0];
+  t.cc_changed[1] = driver.cc_changed[1];
+  memcpy(t.cc, instance.wrapper_cc, sizeof(t.cc));
+  jack_ringbuffer_write(telemetry_ring, (const char*) &t, sizeof(t));
+  driver.cc_changed[0] = driver.cc_changed[1] = 0;
+}
+
+static int process_cb(jack_nframes_t nframes, void* arg) {
+  if (option_realtime) realtime_denormals_off();
+  jack_time_t start = jack_get_time();
+  FOR(i, jack_num_ports) {
+    void* buf = jack_port_get_buffer(jack_port[i], nframes);
+    if (!buf) return 1;
+    if (jack_midi_index[i] >= 0) driver_set_midi(&driver, jack_midi_index[i], buf);
+    else *jack_buf[i] = buf;
+  }
+  void* control = NULL;
+  if (jack_control_port) {
+    control = jack_port_get_buffer(jack_control_port, nframes);
+    if (!control) return 1;
+  } else if (driver.num_midi) {
+    control = driver.view[0].raw;
+  }
+  jack_host_apply_ccs(cc_ring, &instance, jack_last_frame_time(jack_client));
+  jack_time_t plugin_start = jack_get_time();
+  uint64_t plugin_start_cycles = dsp_stats_cycles();
+  driver_process(&driver, &instance, control, nframes);
+  dsp_stats_record(&dsp_stats, jack_get_time() - plugin_start, dsp_stats_cycles() - plugin_start_cycles,
+		   nframes * 1e6 / jack_get_sample_rate(jack_client));
+  send_telemetry(nframes, jack_get_time() - start);
+  return 0;
+}
+
+static int xrun_cb(void* arg) {
+  dsp_stats_xrun(&dsp_stats);
+  return 0;
+}
+
+// Setup and teardown
+
+// Opens the client under name, before plugin_init registers its ports.
+static void jack_host_open(const char* name, JackSessionCallback session_cb) {
+  FOR(i, 128) {
+    instance.cents[i] = (i - 69.0) * 100.0;
+    instance.freq[i] = 440 * pow(2.0, instance.cents[i] / 1200.0);
+  }
+
+  jack_client = jack_client_open(name, JackSessionID, &jack_status, option_uuid);
+  CHECK(jack_client, "jack_client_open");
+  CHECK(!jack_status, "jack_client_open");
+  CHECK(!jack_set_session_callback(jack_client, session_cb, NULL), "jack_set_session_callback");
+  CHECK(!jack_set_process_callback(jack_client, process_cb, NULL), "jack_set_process_callback");
+  CHECK(!jack_set_xrun_callback(jack_client, xrun_cb, NULL), "jack_set_xrun_callback");
+  driver_init(&driver, jack_midi_count, jack_midi_get, plugin_process);
+
+  cc_ring = jack_host_ring(CC_RING_SIZE);
+  telemetry_ring = jack_host_ring(TELEMETRY_RING_SIZE);
+}
+
+// After plugin_init: registers the control port if needed, loads the
+// session's state and starts processing.
+static void jack_host_activate(void) {
+  if (!driver.num_midi) {
+    jack_control_port = jack_port_register(jack_client, "control in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+    CHECK(jack_control_port, "jack_port_register");
+  }
+  if (option_dir) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/state.json", option_dir);
+    jack_host_load(filename);
+  }
+  CHECK(!jack_activate(jack_client), "jack_activate");
+  if (option_realtime) realtime_check_sched(jack_client_thread_id(jack_client), "process thread");
+}
+
+static void jack_host_close(void) {
+  jack_deactivate(jack_client);
+  if (option_stats) jack_host_report_stats();
+  FOR(i, jack_num_ports) jack_port_unregister(jack_client, jack_port[i]);
+  jack_num_ports = 0;
+  if (jack_control_port) jack_port_unregister(jack_client, jack_control_port);
+  jack_control_port = NULL;
+  jack_client_close(jack_client);
+  jack_client = NULL;
+  jack_ringbuffer_free(cc_ring);
+  jack_ringbuffer_free(telemetry_ring);
+}
@@ -1,61 +1,95 @@
+// LADSPA library exporting every plugin in LADSPA_PLUGINS through
+// ladspa_descriptor(index). Descriptors are built from the plugins' static
+// port tables, so listing plugins allocates nothing but the descriptors.
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <ladspa.h>
 #include "wrapper.h"
+#include "plugin-table.h"
+#include "tail.h"
+#include "rtcheck.h"
 
 #define MAX_PORTS 256
+#define SCRATCH_LEN 256
+
+#define X(id, name) PLUGIN_DECLARE(id)				\
+  extern const unsigned id##_plugin_ladspa_unique_id;		\
+  extern const struct plugin_port id##_plugin_static_ports[];	\
+  extern const int id##_plugin_num_static_ports;
+LADSPA_PLUGINS
+#undef X
+
+struct ladspa_plugin {
+  struct plugin_entry entry;
+  const unsigned* unique_id;
+  const struct plugin_port* static_ports;
+  const int* num_static_ports;
+};
+
+static const struct ladspa_plugin plugins[] = {
+#define X(id, name) { PLUGIN_ENTRY(id, name) &id##_plugin_ladspa_unique_id, id##_plugin_static_ports, &id##_plugin_num_static_ports },
+  LADSPA_PLUGINS
+#undef X
+};
+#define NUM_PLUGINS ((int) (sizeof(plugins) / sizeof(plugins[0])))
+
+struct plugin_ports {
+  const struct ladspa_plugin* plugin;
+  int port_cc_number[MAX_PORTS];
+  const char* port_names[MAX_PORTS];
+  LADSPA_PortDescriptor port_descriptors[MAX_PORTS];
+  LADSPA_PortRangeHint port_range_hints[MAX_PORTS];
+  LADSPA_Descriptor descriptor;
+};
+
+static struct plugin_ports* plugin_ports[NUM_PLUGINS];
 
 struct wrapper {
+  struct plugin_ports* ports;
   int num_ports;
   float* port_cc_value[MAX_PORTS];
   float** port_buf[MAX_PORTS];
+  // run_adding for plugins that can only overwrite their outputs: they
+  // render into scratch, which is then added to the host buffers.
+  float* scratch;
 };
-static int port_cc_number[MAX_PORTS];
-static const char* port_names[MAX_PORTS];
-static LADSPA_PortDescriptor port_descriptors[MAX_PORTS];
-static LADSPA_PortRangeHint port_range_hints[MAX_PORTS];
+
+// The plugin must register its ports exactly as its static table says.
+static int add_port(struct wrapper* w, LADSPA_PortDescriptor descriptor, const char* name, int cc_number) {
+  struct plugin_ports* p = w->ports;
+  int port = w->num_ports++;
+  if (port >= (int) p->descriptor.PortCount || p->port_descriptors[port] != descriptor
+      || p->port_cc_number[port] != cc_number || strcmp(p->port_names[port], name)) {
+    fprintf(stderr, "Error: %s registered port %d (%s) differently from its static port table\n",
+	    *p->plugin->entry.name, port, name);
+    exit(1);
+  }
+  return port;
+}
 
 void wrapper_add_cc(struct instance* instance, int cc_number, const char* display_name, const char* persist_name, int default_value) {
   struct wrapper *w = instance->wrapper;
-  CHECK(w->num_ports < MAX_PORTS, "too many ports");
-  instance->wrapper_cc[cc_number] = default_value;
-  int port = w->num_ports++;
-  port_descriptors[port] = LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT;
-  port_names[port] = display_name;  
-  port_range_hints[port].HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE;
-  port_range_hints[port].LowerBound = 0;
-  port_range_hints[port].UpperBound = 127;
-  port_cc_number[port] = cc_number;
+  wrapper_set_cc(instance, cc_number, default_value);
+  int port = add_port(w, LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT, display_name, cc_number);
   w->port_buf[port] = NULL;
 };
 
 void wrapper_add_audio_input(struct instance* instance, const char* name, float** buf) {
   struct wrapper *w = instance->wrapper;
-  CHECK(w->num_ports < MAX_PORTS, "too many ports");
-  int port = w->num_ports++;
-  port_descriptors[port] = LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT;
-  port_names[port] = name;  
-  port_range_hints[port].HintDescriptor = 0;
-  port_range_hints[port].LowerBound = 0;
-  port_range_hints[port].UpperBound = 0;
-  port_cc_number[port] = -1;
+  int port = add_port(w, LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT, name, -1);
   w->port_buf[port] = buf;
 }
 void wrapper_add_audio_output(struct instance* instance, const char* name, float** buf) {
   struct wrapper *w = instance->wrapper;
-  CHECK(w->num_ports < MAX_PORTS, "too many ports");
-  int port = w->num_ports++;
-  port_descriptors[port] = LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT;
-  port_names[port] = name;  
-  port_range_hints[port].HintDescriptor = 0;
-  port_range_hints[port].LowerBound = 0;
-  port_range_hints[port].UpperBound = 0;
-  port_cc_number[port] = -1;
+  int port = add_port(w, LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT, name, -1);
   w->port_buf[port] = buf;
 }
 void wrapper_add_midi_input(struct instance* instance, const char* name, void** buf) {
   *buf = NULL;
-  // ignore
+  // ignore; MIDI ports are left out of the descriptor too
 }
 
 static void connect_port(LADSPA_Handle Instance,
@@ -64,7 +98,7 @@ static void connect_port(LADSPA_Handle Instance,
 {
   struct instance *instance = Instance;
   struct wrapper *w = instance->wrapper;
-  if (port_cc_number[Port] < 0) {
+  if (w->ports->port_cc_number[Port] < 0) {
     *(w->port_buf[Port]) = DataLocation;
   } else {
     w->port_cc_value[Port] = DataLocation;
@@ -74,11 +108,21 @@ static void connect_port(LADSPA_Handle Instance,
 static LADSPA_Handle instantiate(const struct _LADSPA_Descriptor * Descriptor,
 				 unsigned long                     SampleRate)
 {
+  struct plugin_ports* ports = Descriptor->ImplementationData;
   struct instance *instance = calloc(1, sizeof(struct instance));
   struct wrapper *w = calloc(1, sizeof(struct wrapper));
-  w->num_ports = 0;
+  CHECK(instance && w, "out of memory");
+  w->ports = ports;
   instance->wrapper = w;
-  plugin_init(instance, SampleRate);
+  instance->wrapper_run_adding_gain = 1.0f;
+  ports->plugin->entry.init(instance, SampleRate);
+  CHECK(w->num_ports == (int) ports->descriptor.PortCount, "plugin registered fewer ports than its static port table");
+  if (!instance->plugin_can_run_adding) {
+    int num_outputs = 0;
+    FOR(i, w->num_ports) if (ports->port_descriptors[i] == (LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT)) num_outputs++;
+    w->scratch = calloc(num_outputs * SCRATCH_LEN, sizeof(float));
+    CHECK(w->scratch || !num_outputs, "out of memory");
+  }
   return instance;
 }
 
@@ -88,38 +132,161 @@ static void activate(LADSPA_Handle Instance) {
 static void deactivate(LADSPA_Handle Instance) {
 }
 
-static void run(LADSPA_Handle Instance,
-		unsigned long SampleCount)
-{
-  struct instance *instance = Instance;
+static bool ports_connected(struct instance* instance) {
   struct wrapper *w = instance->wrapper;
+  const int* port_cc_number = w->ports->port_cc_number;
   CHECK(w->num_ports <= MAX_PORTS, "w->num_ports overflow");
   FOR(i, w->num_ports) {
     if (port_cc_number[i] >= 0) {
       if (!w->port_cc_value[i]) {
 	//fprintf(stderr, "Port cc %i not connected\n", i);
-	return;
+	return false;
       }
-      instance->wrapper_cc[port_cc_number[i]] = *w->port_cc_value[i];
+      wrapper_set_cc(instance, port_cc_number[i], *w->port_cc_value[i]);
     } else {
       if (!*w->port_buf[i]) {
 	//fprintf(stderr, "Port buf %i not connected\n", i);
-	return;
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Calls the plugin in sub-blocks of at most plugin_block_size frames, with
+// the audio ports advanced for each.
+static void process(struct instance* instance, int nframes) {
+  struct wrapper *w = instance->wrapper;
+  int size = instance->plugin_block_size;
+  if (size <= 0 || nframes <= size) {
+    w->ports->plugin->entry.process(instance, nframes);
+    return;
+  }
+  float* host_buf[MAX_PORTS];
+  FOR(p, w->num_ports) if (w->port_buf[p]) host_buf[p] = *w->port_buf[p];
+  for (int pos = 0; pos < nframes; pos += size) {
+    int n = nframes - pos < size ? nframes - pos : size;
+    FOR(p, w->num_ports) if (w->port_buf[p]) *w->port_buf[p] = host_buf[p] + pos;
+    w->ports->plugin->entry.process(instance, n);
+  }
+  FOR(p, w->num_ports) if (w->port_buf[p]) *w->port_buf[p] = host_buf[p];
+}
+
+static bool ports_silent(struct instance* instance, int nframes, LADSPA_PortDescriptor direction) {
+  struct wrapper *w = instance->wrapper;
+  const LADSPA_PortDescriptor* port_descriptors = w->ports->port_descriptors;
+  FOR(p, w->num_ports) {
+    if (port_descriptors[p] == (LADSPA_PORT_AUDIO | direction) &&
+	tail_peak(*w->port_buf[p], nframes) >= TAIL_SILENCE) return false;
+  }
+  return true;
+}
+
+// Plugins with plugin_tail sleep while their input and tail are silent (see
+// tail.h). Returns whether the plugin should run; if not, the outputs have
+// been zeroed, or left alone when adding.
+static bool wake(struct instance* instance, int nframes, bool adding, bool* silent) {
+  struct wrapper *w = instance->wrapper;
+  *silent = instance->plugin_tail && ports_silent(instance, nframes, LADSPA_PORT_INPUT);
+  if (!*silent) instance->wrapper_sleeping = 0;
+  if (!instance->wrapper_sleeping) return true;
+  if (!adding) {
+    FOR(p, w->num_ports) {
+      if (w->ports->port_descriptors[p] == (LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT)) memset(*w->port_buf[p], 0, nframes * sizeof(float));
+    }
+  }
+  return false;
+}
+
+static void run(LADSPA_Handle Instance,
+		unsigned long SampleCount)
+{
+  struct instance *instance = Instance;
+  bool silent;
+  if (!ports_connected(instance)) return;
+  RTCHECK_ENTER("LADSPA run");
+  if (wake(instance, (int) SampleCount, false, &silent)) {
+    wrapper_cc_dispatch(instance);
+    process(instance, (int) SampleCount);
+    if (instance->plugin_tail) {
+      tail_update(instance, silent, silent && ports_silent(instance, (int) SampleCount, LADSPA_PORT_OUTPUT), (int) SampleCount);
+    }
+  }
+  RTCHECK_LEAVE();
+}
+
+// Processes SCRATCH_LEN frames at a time with the outputs pointed at scratch
+// and adds the result to the host's buffers.
+static void run_adding_via_scratch(struct instance* instance, int nframes) {
+  struct wrapper *w = instance->wrapper;
+  const LADSPA_PortDescriptor* port_descriptors = w->ports->port_descriptors;
+  float gain = instance->wrapper_run_adding_gain;
+  float* host_buf[MAX_PORTS];
+  FOR(p, w->num_ports) if (w->port_buf[p]) host_buf[p] = *w->port_buf[p];
+  for (int pos = 0; pos < nframes; pos += SCRATCH_LEN) {
+    int n = nframes - pos < SCRATCH_LEN ? nframes - pos : SCRATCH_LEN;
+    float* scratch = w->scratch;
+    FOR(p, w->num_ports) {
+      if (!(port_descriptors[p] & LADSPA_PORT_AUDIO)) continue;
+      if (port_descriptors[p] & LADSPA_PORT_INPUT) {
+	*w->port_buf[p] = host_buf[p] + pos;
+      } else {
+	*w->port_buf[p] = scratch;
+	scratch += SCRATCH_LEN;
       }
     }
+    process(instance, n);
+    scratch = w->scratch;
+    FOR(p, w->num_ports) {
+      if (port_descriptors[p] != (LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT)) continue;
+      float* out = host_buf[p] + pos;
+      FOR(i, n) out[i] += gain * scratch[i];
+      scratch += SCRATCH_LEN;
+    }
+  }
+  FOR(p, w->num_ports) if (w->port_buf[p]) *w->port_buf[p] = host_buf[p];
+}
+
+static void run_adding(LADSPA_Handle Instance,
+		       unsigned long SampleCount)
+{
+  struct instance *instance = Instance;
+  bool silent;
+  if (!ports_connected(instance)) return;
+  RTCHECK_ENTER("LADSPA run_adding");
+  if (wake(instance, (int) SampleCount, true, &silent)) {
+    wrapper_cc_dispatch(instance);
+    if (instance->plugin_can_run_adding) {
+      instance->wrapper_run_adding = 1;
+      process(instance, (int) SampleCount);
+      instance->wrapper_run_adding = 0;
+    } else {
+      run_adding_via_scratch(instance, (int) SampleCount);
+    }
+    // The outputs hold the host's mix as well, so only plugin_tail decides.
+    if (instance->plugin_tail) tail_update(instance, silent, silent, (int) SampleCount);
   }
-  plugin_process(instance, (int) SampleCount);
+  RTCHECK_LEAVE();
+}
+
+static void set_run_adding_gain(LADSPA_Handle Instance,
+				LADSPA_Data Gain)
+{
+  struct instance *instance = Instance;
+  instance->wrapper_run_adding_gain = Gain;
 }
 
 static void cleanup(LADSPA_Handle Instance) {
   struct instance* instance = Instance;
-  plugin_destroy(instance);
+  struct wrapper *w = instance->wrapper;
+  w->ports->plugin->entry.destroy(instance);
+  free(w->scratch);
   free(instance->wrapper);
   instance->wrapper = NULL;
   free(instance);
 }
 
-static LADSPA_Descriptor descriptor = {
+static const LADSPA_Descriptor descriptor_template = {
   .UniqueID = '?',
   .Label = "Nolabel",
   .Name = "Noname",
@@ -127,29 +294,67 @@ static LADSPA_Descriptor descriptor = {
   .Maker = "Magnus Jonsson",
   .Copyright = "2015 Magnus Jonsson",
   .PortCount = 0,
-  .PortDescriptors = port_descriptors,
-  .PortNames = port_names,
-  .PortRangeHints =  port_range_hints,
+  .PortDescriptors = NULL,
+  .PortNames = NULL,
+  .PortRangeHints = NULL,
   .ImplementationData = NULL,
   .instantiate = instantiate,
   .connect_port = connect_port,
   .activate = activate,
   .run = run,
-  .run_adding = NULL,
-  .set_run_adding_gain = NULL,
+  .run_adding = run_adding,
+  .set_run_adding_gain = set_run_adding_gain,
   .deactivate = deactivate,
   .cleanup = cleanup,
 };
 
+static struct plugin_ports* describe_plugin(const struct ladspa_plugin* plugin) {
+  struct plugin_ports* p = calloc(1, sizeof(struct plugin_ports));
+  CHECK(p, "out of memory");
+  p->plugin = plugin;
+  int num_ports = 0;
+  FOR(i, *plugin->num_static_ports) {
+    const struct plugin_port* port = &plugin->static_ports[i];
+    if (port->kind == PLUGIN_PORT_MIDI_INPUT) continue;
+    CHECK(num_ports < MAX_PORTS, "too many ports");
+    switch (port->kind) {
+    case PLUGIN_PORT_AUDIO_INPUT: p->port_descriptors[num_ports] = LADSPA_PORT_AUDIO | LADSPA_PORT_INPUT; break;
+    case PLUGIN_PORT_AUDIO_OUTPUT: p->port_descriptors[num_ports] = LADSPA_PORT_AUDIO | LADSPA_PORT_OUTPUT; break;
+    default: p->port_descriptors[num_ports] = LADSPA_PORT_CONTROL | LADSPA_PORT_INPUT; break;
+    }
+    p->port_names[num_ports] = port->name;
+    p->port_cc_number[num_ports] = port->cc_number;
+    if (port->kind == PLUGIN_PORT_CC) {
+      p->port_range_hints[num_ports].HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE;
+      p->port_range_hints[num_ports].LowerBound = 0;
+      p->port_range_hints[num_ports].UpperBound = 127;
+    }
+    num_ports++;
+  }
+
+  p->descriptor = descriptor_template;
+  p->descriptor.UniqueID = *plugin->unique_id;
+  p->descriptor.Label = *plugin->entry.name;
+  p->descriptor.Name = *plugin->entry.name;
+  p->descriptor.PortCount = num_ports;
+  p->descriptor.PortDescriptors = p->port_descriptors;
+  p->descriptor.PortNames = p->port_names;
+  p->descriptor.PortRangeHints = p->port_range_hints;
+  p->descriptor.ImplementationData = p;
+  return p;
+}
+
 __attribute__ ((visibility ("default")))
 const LADSPA_Descriptor *ladspa_descriptor(unsigned long index)  {
-  if (index != 0) return NULL;
-  struct instance *instance = instantiate(NULL, 0.0);
-  descriptor.UniqueID = plugin_ladspa_unique_id;
-  descriptor.Label = plugin_name;
-  descriptor.Name = plugin_name;
-  struct wrapper *w = instance->wrapper;
-  descriptor.PortCount = w->num_ports;
-  cleanup(instance);
-  return &descriptor;
+  if (index >= NUM_PLUGINS) return NULL;
+  if (!plugin_ports[index]) plugin_ports[index] = describe_plugin(&plugins[index]);
+  return &plugin_ports[index]->descriptor;
+}
+
+__attribute__ ((destructor))
+static void free_plugin_ports(void) {
+  FOR(i, NUM_PLUGINS) {
+    free(plugin_ports[i]);
+    plugin_ports[i] = NULL;
+  }
 }
@@ -0,0 +1,89 @@
+// Ports, controls and tuning for the wrappers that run a plugin without an
+// audio server (render-wrapper.c, bench-wrapper.c).
+//
+// The wrapper_add_* callbacks record the plugin's ports in registration
+// order; the wrapper points them at its buffers after plugin_init.
+//
+//   offline_default_tuning(&instance);
+//   plugin_init(&instance, sample_rate);
+//   FOR(i, num_cc_options) offline_set_cc_option(&instance, cc_options[i]);
+//   FOR(p, offline_num_ports) ... *offline_port_buf[p] = ...
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OFFLINE_MAX_PORTS 64
+
+enum port_type { PORT_AUDIO_INPUT, PORT_AUDIO_OUTPUT, PORT_MIDI_INPUT };
+
+static int offline_num_ports;
+static enum port_type offline_port_type[OFFLINE_MAX_PORTS];
+static void** offline_port_buf[OFFLINE_MAX_PORTS];
+
+static const char* offline_cc_persist_name[128];
+static bool offline_cc_registered[128];
+
+void wrapper_add_cc(struct instance* instance, int cc_number, const char* display_name, const char* persist_name, int default_value) {
+  wrapper_set_cc(instance, cc_number, default_value);
+  offline_cc_persist_name[cc_number] = persist_name;
+  offline_cc_registered[cc_number] = true;
+}
+
+static void offline_add_port(enum port_type type, void** buf) {
+  CHECK(offline_num_ports < OFFLINE_MAX_PORTS, "too many ports");
+  int i = offline_num_ports++;
+  offline_port_type[i] = type;
+  offline_port_buf[i] = buf;
+}
+
+void wrapper_add_audio_input(struct instance* instance, const char* name, float** buf) {
+  offline_add_port(PORT_AUDIO_INPUT, (void**) buf);
+}
+
+void wrapper_add_audio_output(struct instance* instance, const char* name, float** buf) {
+  offline_add_port(PORT_AUDIO_OUTPUT, (void**) buf);
+}
+
+void wrapper_add_midi_input(struct instance* instance, const char* name, void** buf) {
+  offline_add_port(PORT_MIDI_INPUT, buf);
+}
+
+// Equal temperament with cents relative to A4, as in the JACK wrappers
+static void offline_default_tuning(struct instance* instance) {
+  FOR(i, 128) {
+    instance->cents[i] = (i - 69.0) * 100.0;
+    instance->freq[i] = 440 * pow(2.0, instance->cents[i] / 1200.0);
+  }
+}
+
+// --cc NAME=VALUE, where NAME is a persist name or a cc number
+static void offline_set_cc_option(struct instance* instance, const char* option) {
+  const char* eq = strchr(option, '=');
+  if (!eq) {
+    fprintf(stderr, "Error: --cc expects NAME=VALUE, got %s\n", option);
+    exit(1);
+  }
+  int len = eq - option;
+  int value = atoi(eq + 1);
+  CHECK(value >= 0 && value <= 127, "--cc value must be between 0 and 127");
+  FOR(cc, 128) {
+    if (!offline_cc_registered[cc]) continue;
+    char number[8];
+    snprintf(number, sizeof number, "%d", cc);
+    if ((strlen(offline_cc_persist_name[cc]) == (size_t) len && !strncmp(offline_cc_persist_name[cc], option, len)) ||
+	(strlen(number) == (size_t) len && !strncmp(number, option, len))) {
+      wrapper_set_cc(instance, cc, value);
+      return;
+    }
+  }
+  fprintf(stderr, "Error: %s has no control named %.*s. Controls:\n", plugin_name, len, option);
+  FOR(cc, 128) {
+    if (offline_cc_registered[cc]) {
+      fprintf(stderr, "  %s (cc %d, default %d)\n", offline_cc_persist_name[cc], cc, instance->wrapper_cc[cc]);
+    }
+  }
+  exit(1);
+}
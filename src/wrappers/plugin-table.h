@@ -0,0 +1,31 @@
+// Several plugins can be linked into one binary when their entry points are
+// renamed from plugin_init etc. to <id>_plugin_init etc. (the %-plugin.o rule
+// in the Makefile does this). The wrapper then lists them with an X-macro:
+//
+//   #define X(id, name) PLUGIN_DECLARE(id)
+//   PLUGINS
+//   #undef X
+//   static const struct plugin_entry plugins[] = {
+//   #define X(id, name) PLUGIN_ENTRY(id, name)
+//     PLUGINS
+//   #undef X
+//   };
+
+struct plugin_entry {
+  const char* id;
+  void (*init)(struct instance* instance, double sample_rate);
+  void (*destroy)(struct instance* instance);
+  void (*process)(struct instance* instance, int nframes);
+  const char* const* name;
+  const char* const* persistence_name;
+};
+
+#define PLUGIN_DECLARE(id)						\
+  extern void id##_plugin_init(struct instance* instance, double sample_rate); \
+  extern void id##_plugin_destroy(struct instance* instance);		\
+  extern void id##_plugin_process(struct instance* instance, int nframes); \
+  extern const char* id##_plugin_name;					\
+  extern const char* id##_plugin_persistence_name;
+
+#define PLUGIN_ENTRY(id, cli_name)					\
+  { cli_name, id##_plugin_init, id##_plugin_destroy, id##_plugin_process, &id##_plugin_name, &id##_plugin_persistence_name },
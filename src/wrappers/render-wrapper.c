@@ -0,0 +1,595 @@
+// Offline renderer: runs a plugin over WAV and Standard MIDI Files as fast
+// as the CPU allows, without JACK or GTK.
+//
+//   reverb-render -i dry.wav -o wet.wav --cc wet=90 --tail 3
+//   polysaw-render -m song.mid -o song.wav -r 96000
+//
+// The channels of all input files are concatenated and fed to the plugin's
+// audio inputs in registration order; missing channels are silent. All audio
+// outputs are written as the channels of one 32-bit float WAV file. Every MIDI
+// input of the plugin receives the merged tracks of the MIDI file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "wrapper.h"
+#include "tail.h"
+#include "rtcheck.h"
+#include "driver.h"
+#include "offline.h"
+#include "../tuning/scala.h"
+
+#define MAX_INPUT_FILES 16
+#define MAX_CC_OPTIONS 128
+
+static struct instance instance;
+static struct driver driver;
+
+// Byte order helpers
+
+static uint32_t get_le16(const unsigned char* p) { return p[0] | p[1] << 8; }
+static uint32_t get_le32(const unsigned char* p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24; }
+static uint32_t get_be16(const unsigned char* p) { return p[0] << 8 | p[1]; }
+static uint32_t get_be32(const unsigned char* p) { return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static void put_le16(unsigned char* p, uint32_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_le32(unsigned char* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+// WAV input
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+struct wav_in {
+  FILE* fp;
+  int format;
+  int channels;
+  int sample_rate;
+  int bytes_per_sample;
+  long frames;
+  long frames_read;
+  unsigned char* raw;
+  int raw_frames;
+};
+
+static void wav_open(struct wav_in* w, const char* filename) {
+  w->fp = fopen(filename, "rb");
+  if (!w->fp) {
+    fprintf(stderr, "Error: could not open %s\n", filename);
+    exit(1);
+  }
+  unsigned char header[12];
+  if (fread(header, 1, 12, w->fp) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+    fprintf(stderr, "Error: %s is not a WAV file\n", filename);
+    exit(1);
+  }
+  bool have_fmt = false;
+  long data_size;
+  while (1) {
+    unsigned char chunk[8];
+    if (fread(chunk, 1, 8, w->fp) != 8) {
+      fprintf(stderr, "Error: no data chunk in %s\n", filename);
+      exit(1);
+    }
+    uint32_t size = get_le32(chunk + 4);
+    if (!memcmp(chunk, "data", 4)) {
+      data_size = size;
+      break;
+    }
+    long skip = size + (size & 1);
+    if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+      unsigned char fmt[40] = { 0 };
+      uint32_t n = size < sizeof fmt ? size : sizeof fmt;
+      CHECK(fread(fmt, 1, n, w->fp) == n, "truncated fmt chunk");
+      skip -= n;
+      w->format = get_le16(fmt);
+      w->channels = get_le16(fmt + 2);
+      w->sample_rate = get_le32(fmt + 4);
+      w->bytes_per_sample = get_le16(fmt + 14) / 8;
+      if (w->format == WAV_FORMAT_EXTENSIBLE && n >= 26) {
+	w->format = get_le16(fmt + 24);
+      }
+      have_fmt = true;
+    }
+    fseek(w->fp, skip, SEEK_CUR);
+  }
+  bool supported =
+    have_fmt && w->channels > 0 &&
+    ((w->format == WAV_FORMAT_PCM && w->bytes_per_sample >= 1 && w->bytes_per_sample <= 4) ||
+     (w->format == WAV_FORMAT_FLOAT && (w->bytes_per_sample == 4 || w->bytes_per_sample == 8)));
+  if (!supported) {
+    fprintf(stderr, "Error: unsupported sample format in %s\n", filename);
+    exit(1);
+  }
+  // Streamed WAVs often leave the data size at 0 or 0xffffffff; trust the file length then.
+  long data_start = ftell(w->fp);
+  fseek(w->fp, 0, SEEK_END);
+  long available = ftell(w->fp) - data_start;
+  fseek(w->fp, data_start, SEEK_SET);
+  if (data_size == 0 || data_size > available) data_size = available;
+  w->frames = data_size / (w->channels * w->bytes_per_sample);
+}
+
+static float wav_decode(const struct wav_in* w, const unsigned char* p) {
+  if (w->format == WAV_FORMAT_FLOAT) {
+    if (w->bytes_per_sample == 4) {
+      uint32_t u = get_le32(p);
+      float f;
+      memcpy(&f, &u, sizeof f);
+      return f;
+    } else {
+      uint64_t u = get_le32(p) | (uint64_t) get_le32(p + 4) << 32;
+      double d;
+      memcpy(&d, &u, sizeof d);
+      return d;
+    }
+  }
+  switch (w->bytes_per_sample) {
+  case 1: return (p[0] - 128) * (1.0f / 128);
+  case 2: return (int16_t) get_le16(p) * (1.0f / 32768);
+  case 3: return ((int32_t) (get_le32(p) << 8) >> 8) * (1.0f / 8388608);
+  default: return (int32_t) get_le32(p) * (1.0f / 2147483648.0f);
+  }
+}
+
+// Reads the next n frames, deinterleaving into out[0..channels). Frames
+// past the end of the file are silent.
+static void wav_read(struct wav_in* w, float** out, int n) {
+  int frame_bytes = w->channels * w->bytes_per_sample;
+  if (w->raw_frames < n) {
+    free(w->raw);
+    w->raw = malloc((size_t) n * frame_bytes);
+    CHECK(w->raw, "out of memory");
+    w->raw_frames = n;
+  }
+  int got = 0;
+  if (w->frames_read < w->frames) {
+    long want = w->frames - w->frames_read < n ? w->frames - w->frames_read : n;
+    got = fread(w->raw, frame_bytes, want, w->fp);
+    w->frames_read += got;
+  }
+  FOR(c, w->channels) {
+    FOR(i, got) out[c][i] = wav_decode(w, w->raw + i * frame_bytes + c * w->bytes_per_sample);
+    for (int i = got; i < n; i++) out[c][i] = 0;
+  }
+}
+
+static void wav_close(struct wav_in* w) {
+  fclose(w->fp);
+  free(w->raw);
+  w->raw = NULL;
+}
+
+// WAV output, always 32-bit float. The header is rewritten with the final
+// sizes when the file is finished.
+
+#define WAV_OUT_HEADER_SIZE 58
+
+struct wav_out {
+  FILE* fp;
+  int channels;
+  int sample_rate;
+  long frames;
+  float* interleaved;
+  int interleaved_frames;
+};
+
+static void wav_write_header(struct wav_out* w) {
+  unsigned char h[WAV_OUT_HEADER_SIZE];
+  uint32_t data_size = w->frames * w->channels * 4;
+  memcpy(h, "RIFF", 4); put_le32(h + 4, WAV_OUT_HEADER_SIZE - 8 + data_size);
+  memcpy(h + 8, "WAVE", 4);
+  memcpy(h + 12, "fmt ", 4); put_le32(h + 16, 18);
+  put_le16(h + 20, WAV_FORMAT_FLOAT);
+  put_le16(h + 22, w->channels);
+  put_le32(h + 24, w->sample_rate);
+  put_le32(h + 28, w->sample_rate * w->channels * 4);
+  put_le16(h + 32, w->channels * 4);
+  put_le16(h + 34, 32);
+  put_le16(h + 36, 0);
+  memcpy(h + 38, "fact", 4); put_le32(h + 42, 4); put_le32(h + 46, w->frames);
+  memcpy(h + 50, "data", 4); put_le32(h + 54, data_size);
+  fseek(w->fp, 0, SEEK_SET);
+  CHECK(fwrite(h, 1, sizeof h, w->fp) == sizeof h, "could not write WAV header");
+}
+
+static void wav_create(struct wav_out* w, const char* filename, int channels, int sample_rate) {
+  w->fp = fopen(filename, "wb");
+  if (!w->fp) {
+    fprintf(stderr, "Error: could not create %s\n", filename);
+    exit(1);
+  }
+  w->channels = channels;
+  w->sample_rate = sample_rate;
+  wav_write_header(w);
+}
+
+static void wav_write(struct wav_out* w, float** in, int n) {
+  if (w->interleaved_frames < n) {
+    free(w->interleaved);
+    w->interleaved = malloc((size_t) n * w->channels * sizeof(float));
+    CHECK(w->interleaved, "out of memory");
+    w->interleaved_frames = n;
+  }
+  FOR(c, w->channels) FOR(i, n) w->interleaved[i * w->channels + c] = in[c][i];
+  CHECK(fwrite(w->interleaved, sizeof(float) * w->channels, n, w->fp) == (size_t) n, "could not write WAV data");
+  w->frames += n;
+}
+
+static void wav_finish(struct wav_out* w) {
+  wav_write_header(w);
+  fclose(w->fp);
+  free(w->interleaved);
+  w->interleaved = NULL;
+}
+
+// Standard MIDI File input. All tracks are merged into one list of channel
+// messages stamped with absolute frame numbers. System exclusive and meta
+// events other than tempo changes are dropped.
+
+struct timed_event {
+  long tick;
+  long frame;
+  int order;
+  bool is_tempo;
+  uint32_t tempo;
+  int size;
+  unsigned char data[3];
+};
+
+static struct timed_event* midi_events;
+static int num_midi_events;
+static int midi_events_capacity;
+
+static void push_midi_event(struct timed_event e) {
+  if (num_midi_events == midi_events_capacity) {
+    midi_events_capacity = midi_events_capacity ? 2 * midi_events_capacity : 1024;
+    midi_events = realloc(midi_events, midi_events_capacity * sizeof(struct timed_event));
+    CHECK(midi_events, "out of memory");
+  }
+  e.order = num_midi_events;
+  midi_events[num_midi_events++] = e;
+}
+
+static int compare_ticks(const void* a, const void* b) {
+  const struct timed_event* x = a;
+  const struct timed_event* y = b;
+  if (x->tick != y->tick) return x->tick < y->tick ? -1 : 1;
+  return x->order - y->order;
+}
+
+static uint32_t read_varlen(const unsigned char** p, const unsigned char* end) {
+  uint32_t v = 0;
+  while (*p < end) {
+    unsigned char c = *(*p)++;
+    v = (v << 7) | (c & 0x7f);
+    if (!(c & 0x80)) break;
+  }
+  return v;
+}
+
+static void parse_track(const unsigned char* p, const unsigned char* end) {
+  long tick = 0;
+  unsigned char running_status = 0;
+  while (p < end) {
+    tick += read_varlen(&p, end);
+    if (p >= end) break;
+    unsigned char status = *p;
+    if (status == 0xff) {
+      if (end - p < 2) break;
+      unsigned char type = p[1];
+      p += 2;
+      uint32_t len = read_varlen(&p, end);
+      if (len > (uint32_t) (end - p)) break;
+      if (type == 0x51 && len == 3) {
+	push_midi_event((struct timed_event) { .tick = tick, .is_tempo = true, .tempo = p[0] << 16 | p[1] << 8 | p[2] });
+      }
+      if (type == 0x2f) break;
+      p += len;
+    } else if (status == 0xf0 || status == 0xf7) {
+      p++;
+      uint32_t len = read_varlen(&p, end);
+      if (len > (uint32_t) (end - p)) break;
+      p += len;
+      running_status = 0;
+    } else {
+      if (status & 0x80) {
+	running_status = status;
+	p++;
+      }
+      if (!running_status) break;
+      int type = running_status & 0xf0;
+      int size = (type == 0xc0 || type == 0xd0) ? 2 : 3;
+      if (end - p < size - 1) break;
+      struct timed_event e = { .tick = tick, .size = size };
+      e.data[0] = running_status;
+      FOR(i, size - 1) e.data[1 + i] = p[i];
+      p += size - 1;
+      push_midi_event(e);
+    }
+  }
+}
+
+static void load_midi_file(const char* filename, double sample_rate) {
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Error: could not open %s\n", filename);
+    exit(1);
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  unsigned char* file = malloc(size > 0 ? size : 1);
+  CHECK(file && fread(file, 1, size, fp) == (size_t) size, "could not read MIDI file");
+  fclose(fp);
+  if (size < 14 || memcmp(file, "MThd", 4) || get_be32(file + 4) < 6) {
+    fprintf(stderr, "Error: %s is not a Standard MIDI File\n", filename);
+    exit(1);
+  }
+  int num_tracks = get_be16(file + 10);
+  int division = get_be16(file + 12);
+  const unsigned char* p = file + 8 + get_be32(file + 4);
+  const unsigned char* end = file + size;
+  int tracks_found = 0;
+  while (tracks_found < num_tracks && end - p >= 8) {
+    uint32_t len = get_be32(p + 4);
+    if (len > (uint32_t) (end - p - 8)) len = end - p - 8;
+    if (!memcmp(p, "MTrk", 4)) {
+      parse_track(p + 8, p + 8 + len);
+      tracks_found++;
+    }
+    p += 8 + len;
+  }
+  free(file);
+
+  qsort(midi_events, num_midi_events, sizeof(struct timed_event), compare_ticks);
+
+  // Convert ticks to frames, following the tempo map.
+  double seconds_per_tick;
+  bool smpte = division & 0x8000;
+  if (smpte) {
+    int fps = -(int8_t) (division >> 8);
+    int ticks_per_frame = division & 0xff;
+    CHECK(fps > 0 && ticks_per_frame > 0, "bad SMPTE division in MIDI file");
+    seconds_per_tick = 1.0 / (fps * ticks_per_frame);
+  } else {
+    CHECK(division > 0, "bad division in MIDI file");
+    seconds_per_tick = 0.5 / division;
+  }
+  long last_tick = 0;
+  double last_seconds = 0;
+  int n = 0;
+  FOR(i, num_midi_events) {
+    struct timed_event e = midi_events[i];
+    double seconds = last_seconds + (e.tick - last_tick) * seconds_per_tick;
+    last_tick = e.tick;
+    last_seconds = seconds;
+    if (e.is_tempo) {
+      if (!smpte && e.tempo > 0) seconds_per_tick = e.tempo * 1e-6 / division;
+      continue;
+    }
+    e.frame = lround(seconds * sample_rate);
+    midi_events[n++] = e;
+  }
+  num_midi_events = n;
+}
+
+// The MIDI buffer handed to plugins is a window into midi_events.
+
+struct midi_block {
+  int first;
+  int count;
+  long block_start;
+};
+
+static struct midi_block midi_block;
+
+int wrapper_get_num_midi_events(void* buf) {
+  return driver_midi_view_count(buf);
+}
+
+struct midi_event wrapper_get_midi_event(void* buf, int index) {
+  return driver_midi_view_get(buf, index);
+}
+
+// Every MIDI input sees the whole file; CCs in it also drive wrapper_cc.
+
+static int midi_block_count(void* buf) {
+  return ((struct midi_block*) buf)->count;
+}
+
+static struct midi_event midi_block_get(void* buf, int index) {
+  struct midi_block* b = buf;
+  struct timed_event* e = &midi_events[b->first + index];
+  return (struct midi_event) { .time = e->frame - b->block_start, .size = e->size, .buffer = e->data };
+}
+
+// Command line
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+	  "Usage: %s [options] -o OUTPUT.wav\n"
+	  "  -i, --input FILE.wav     audio input, may be repeated\n"
+	  "  -m, --midi FILE.mid      MIDI input\n"
+	  "  -o, --output FILE.wav    32-bit float output\n"
+	  "  -r, --sample-rate HZ     default: input file rate, else 48000\n"
+	  "  -b, --block-size N       frames per process call (default 256)\n"
+	  "  -t, --tail SECONDS       extra time rendered after the inputs end (default 0)\n"
+	  "  -l, --length SECONDS     render exactly this long\n"
+	  "  -c, --cc NAME=VALUE      set a control by name or cc number, may be repeated\n"
+	  "  -s, --scala FILE.scl     tuning\n",
+	  argv0);
+}
+
+int main(int argc, char** argv) {
+  const char* input_filenames[MAX_INPUT_FILES];
+  int num_input_files = 0;
+  const char* cc_options[MAX_CC_OPTIONS];
+  int num_cc_options = 0;
+  const char* midi_filename = NULL;
+  const char* output_filename = NULL;
+  const char* scala_filename = NULL;
+  int sample_rate = 0;
+  int block_size = 256;
+  double tail = 0;
+  double length = -1;
+
+  static struct option long_options[] = {
+    { "input", required_argument, 0, 'i' },
+    { "midi", required_argument, 0, 'm' },
+    { "output", required_argument, 0, 'o' },
+    { "sample-rate", required_argument, 0, 'r' },
+    { "block-size", required_argument, 0, 'b' },
+    { "tail", required_argument, 0, 't' },
+    { "length", required_argument, 0, 'l' },
+    { "cc", required_argument, 0, 'c' },
+    { "scala", required_argument, 0, 's' },
+    { "help", no_argument, 0, 'h' },
+    { 0, 0, 0, 0 },
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "i:m:o:r:b:t:l:c:s:h", long_options, NULL)) != -1) {
+    switch (c) {
+    case 'i':
+      CHECK(num_input_files < MAX_INPUT_FILES, "too many input files");
+      input_filenames[num_input_files++] = optarg;
+      break;
+    case 'm': midi_filename = optarg; break;
+    case 'o': output_filename = optarg; break;
+    case 'r': sample_rate = atoi(optarg); break;
+    case 'b': block_size = atoi(optarg); break;
+    case 't': tail = atof(optarg); break;
+    case 'l': length = atof(optarg); break;
+    case 'c':
+      CHECK(num_cc_options < MAX_CC_OPTIONS, "too many --cc options");
+      cc_options[num_cc_options++] = optarg;
+      break;
+    case 's': scala_filename = optarg; break;
+    case 'h': usage(argv[0]); exit(0);
+    default: usage(argv[0]); exit(1);
+    }
+  }
+  if (!output_filename || optind < argc) {
+    usage(argv[0]);
+    exit(1);
+  }
+  CHECK(block_size > 0, "block size must be positive");
+
+  struct wav_in inputs[MAX_INPUT_FILES] = { { 0 } };
+  long input_frames = 0;
+  FOR(f, num_input_files) {
+    wav_open(&inputs[f], input_filenames[f]);
+    if (!sample_rate) sample_rate = inputs[f].sample_rate;
+    if (inputs[f].sample_rate != sample_rate) {
+      fprintf(stderr, "Error: %s is %d Hz, rendering at %d Hz\n", input_filenames[f], inputs[f].sample_rate, sample_rate);
+      exit(1);
+    }
+    if (inputs[f].frames > input_frames) input_frames = inputs[f].frames;
+  }
+  if (!sample_rate) sample_rate = 48000;
+
+  offline_default_tuning(&instance);
+  if (scala_filename) {
+    CHECK(load_scala_file(scala_filename, instance.cents, instance.freq), "could not load scala file");
+  }
+
+  driver_init(&driver, midi_block_count, midi_block_get, plugin_process);
+  plugin_init(&instance, sample_rate);
+  FOR(i, num_cc_options) offline_set_cc_option(&instance, cc_options[i]);
+
+  if (midi_filename) load_midi_file(midi_filename, sample_rate);
+  long midi_frames = num_midi_events ? midi_events[num_midi_events - 1].frame + 1 : 0;
+
+  long total_frames = input_frames > midi_frames ? input_frames : midi_frames;
+  total_frames += lround(tail * sample_rate);
+  if (length >= 0) total_frames = lround(length * sample_rate);
+
+  float* input_channel[OFFLINE_MAX_PORTS];
+  float* output_channel[OFFLINE_MAX_PORTS];
+  int num_audio_inputs = 0;
+  int num_audio_outputs = 0;
+  FOR(p, offline_num_ports) {
+    void** buf = offline_port_buf[p];
+    switch (offline_port_type[p]) {
+    case PORT_AUDIO_INPUT:
+      input_channel[num_audio_inputs] = memalign(64, block_size * sizeof(float));
+      CHECK(input_channel[num_audio_inputs], "out of memory");
+      memset(input_channel[num_audio_inputs], 0, block_size * sizeof(float));
+      *buf = input_channel[num_audio_inputs++];
+      driver_add_audio(&driver, (float**) buf, false);
+      break;
+    case PORT_AUDIO_OUTPUT:
+      output_channel[num_audio_outputs] = memalign(64, block_size * sizeof(float));
+      CHECK(output_channel[num_audio_outputs], "out of memory");
+      *buf = output_channel[num_audio_outputs++];
+      driver_add_audio(&driver, (float**) buf, true);
+      break;
+    case PORT_MIDI_INPUT:
+      driver_add_midi(&driver, buf);
+      break;
+    }
+  }
+  FOR(m, driver.num_midi) driver_set_midi(&driver, m, &midi_block);
+  CHECK(num_audio_outputs > 0, "plugin has no audio outputs");
+
+  // File channels map onto plugin inputs in order; the rest are read into a
+  // scratch buffer and dropped.
+  float* discard = malloc(block_size * sizeof(float));
+  CHECK(discard, "out of memory");
+  float** file_channels[MAX_INPUT_FILES];
+  int channel_index = 0;
+  FOR(f, num_input_files) {
+    file_channels[f] = malloc(inputs[f].channels * sizeof(float*));
+    CHECK(file_channels[f], "out of memory");
+    FOR(ch, inputs[f].channels) {
+      file_channels[f][ch] = channel_index < num_audio_inputs ? input_channel[channel_index] : discard;
+      channel_index++;
+    }
+  }
+  if (channel_index > num_audio_inputs) {
+    fprintf(stderr, "Warning: %d input channels but %s has %d audio inputs; extra channels ignored\n",
+	    channel_index, plugin_name, num_audio_inputs);
+  }
+
+  struct wav_out output = { 0 };
+  wav_create(&output, output_filename, num_audio_outputs, sample_rate);
+
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int next_event = 0;
+  for (long pos = 0; pos < total_frames; pos += block_size) {
+    int n = total_frames - pos < block_size ? total_frames - pos : block_size;
+    FOR(f, num_input_files) wav_read(&inputs[f], file_channels[f], n);
+    midi_block.first = next_event;
+    midi_block.block_start = pos;
+    while (next_event < num_midi_events && midi_events[next_event].frame < pos + n) next_event++;
+    midi_block.count = next_event - midi_block.first;
+    driver_process(&driver, &instance, &midi_block, n);
+    wav_write(&output, output_channel, n);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  double elapsed = (stop.tv_sec - start.tv_sec) + 1e-9 * (stop.tv_nsec - start.tv_nsec);
+  double rendered = (double) total_frames / sample_rate;
+  fprintf(stderr, "%s: rendered %.2f s in %.2f s (%.1fx realtime)\n",
+	  plugin_name, rendered, elapsed, elapsed > 0 ? rendered / elapsed : 0.0);
+
+  wav_finish(&output);
+  plugin_destroy(&instance);
+  FOR(f, num_input_files) {
+    wav_close(&inputs[f]);
+    free(file_channels[f]);
+  }
+  FOR(i, num_audio_inputs) free(input_channel[i]);
+  FOR(i, num_audio_outputs) free(output_channel[i]);
+  free(discard);
+  free(midi_events);
+  return 0;
+}
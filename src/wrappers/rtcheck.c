@@ -0,0 +1,247 @@
+// RT-safety checker: reports calls that may allocate, block or enter the
+// kernel while the audio thread is inside plugin code.
+//
+// It is linked into the %-rtcheck renderers, which `make rtcheck` runs over
+// every plugin (rtcheck.sh), and built as rtcheck.so for LV2 hosts:
+//
+//   make RTCHECK=1 rtcheck.so src/lv2/synth/synth.so
+//   LD_PRELOAD=./rtcheck.so jalv.gtk http://...
+//
+// The functions below replace the libc ones for the whole process. Outside
+// RTCHECK_ENTER/RTCHECK_LEAVE (rtcheck.h) they pass straight through. Inside,
+// the first call from each call site prints the function, the label given to
+// RTCHECK_ENTER and a backtrace to stderr; later calls from the same site are
+// only counted. A summary is printed at exit.
+//
+// glibc calls its own write, open and mutexes directly, so a printf that
+// writes to the terminal is never seen as a write. The stdio functions, which
+// lock the FILE and may allocate and write, and rand/random, which lock their
+// state, are therefore checked themselves.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define EXPORT __attribute__((visibility("default")))
+
+#define MAX_SITES 1024
+#define MAX_FRAMES 32
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* p);
+
+static __thread int depth;
+static __thread const char* label;
+static __thread bool reporting;
+
+static void* sites[MAX_SITES];
+static int num_sites;
+static int sites_lock;
+static long num_calls;
+
+// Looks up the next definition of a function, i.e. the one in libc.
+#define REAL(name) \
+  static __typeof__(&name) real_##name; \
+  if (!real_##name) real_##name = dlsym(RTLD_NEXT, #name)
+
+EXPORT void rtcheck_enter(const char* where) {
+  if (depth++ == 0) label = where;
+}
+
+EXPORT void rtcheck_leave(void) {
+  depth--;
+}
+
+static bool new_site(void* site) {
+  bool found = false;
+  while (__atomic_exchange_n(&sites_lock, 1, __ATOMIC_ACQUIRE)) { }
+  for (int i = 0; i < num_sites && !found; i++) found = sites[i] == site;
+  if (!found && num_sites < MAX_SITES) sites[num_sites++] = site;
+  __atomic_store_n(&sites_lock, 0, __ATOMIC_RELEASE);
+  return !found;
+}
+
+static void report(const char* function, void* site) {
+  reporting = true;
+  __atomic_add_fetch(&num_calls, 1, __ATOMIC_RELAXED);
+  if (new_site(site)) {
+    void* frames[MAX_FRAMES];
+    int n = backtrace(frames, MAX_FRAMES);
+    dprintf(2, "rtcheck: %s() in %s\n", function, label);
+    backtrace_symbols_fd(frames + 1, n - 1, 2);
+  }
+  reporting = false;
+}
+
+// The report itself may allocate, so it is not checked.
+#define CHECK_RT(function) do { \
+    if (depth > 0 && !reporting) report(function, __builtin_return_address(0)); \
+  } while (0)
+
+// backtrace loads libgcc on its first call, which should not happen in the
+// middle of a report.
+__attribute__((constructor)) static void init(void) {
+  void* frame;
+  backtrace(&frame, 1);
+}
+
+__attribute__((destructor)) static void summary(void) {
+  if (num_calls) dprintf(2, "rtcheck: %ld RT-unsafe calls from %d call sites\n", num_calls, num_sites);
+}
+
+// Memory
+
+EXPORT void* malloc(size_t size) {
+  CHECK_RT("malloc");
+  return __libc_malloc(size);
+}
+
+EXPORT void* calloc(size_t n, size_t size) {
+  CHECK_RT("calloc");
+  return __libc_calloc(n, size);
+}
+
+EXPORT void* realloc(void* p, size_t size) {
+  CHECK_RT("realloc");
+  return __libc_realloc(p, size);
+}
+
+EXPORT void* memalign(size_t alignment, size_t size) {
+  CHECK_RT("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+EXPORT int posix_memalign(void** p, size_t alignment, size_t size) {
+  CHECK_RT("posix_memalign");
+  REAL(posix_memalign);
+  return real_posix_memalign(p, alignment, size);
+}
+
+EXPORT void free(void* p) {
+  CHECK_RT("free");
+  __libc_free(p);
+}
+
+// Locks
+
+EXPORT int pthread_mutex_lock(pthread_mutex_t* mutex) {
+  CHECK_RT("pthread_mutex_lock");
+  REAL(pthread_mutex_lock);
+  return real_pthread_mutex_lock(mutex);
+}
+
+EXPORT int rand(void) {
+  CHECK_RT("rand");
+  REAL(rand);
+  return real_rand();
+}
+
+EXPORT long random(void) {
+  CHECK_RT("random");
+  REAL(random);
+  return real_random();
+}
+
+// System calls
+
+EXPORT int open(const char* path, int flags, ...) {
+  CHECK_RT("open");
+  REAL(open);
+  va_list args;
+  va_start(args, flags);
+  mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? va_arg(args, mode_t) : 0;
+  va_end(args);
+  return real_open(path, flags, mode);
+}
+
+EXPORT ssize_t read(int fd, void* buf, size_t count) {
+  CHECK_RT("read");
+  REAL(read);
+  return real_read(fd, buf, count);
+}
+
+EXPORT ssize_t write(int fd, const void* buf, size_t count) {
+  CHECK_RT("write");
+  REAL(write);
+  return real_write(fd, buf, count);
+}
+
+// stdio
+
+EXPORT FILE* fopen(const char* path, const char* mode) {
+  CHECK_RT("fopen");
+  REAL(fopen);
+  return real_fopen(path, mode);
+}
+
+EXPORT int vfprintf(FILE* fp, const char* format, va_list args) {
+  CHECK_RT("vfprintf");
+  REAL(vfprintf);
+  return real_vfprintf(fp, format, args);
+}
+
+EXPORT int vprintf(const char* format, va_list args) {
+  CHECK_RT("vprintf");
+  REAL(vfprintf);
+  return real_vfprintf(stdout, format, args);
+}
+
+EXPORT int fprintf(FILE* fp, const char* format, ...) {
+  CHECK_RT("fprintf");
+  REAL(vfprintf);
+  va_list args;
+  va_start(args, format);
+  int ret = real_vfprintf(fp, format, args);
+  va_end(args);
+  return ret;
+}
+
+EXPORT int printf(const char* format, ...) {
+  CHECK_RT("printf");
+  REAL(vfprintf);
+  va_list args;
+  va_start(args, format);
+  int ret = real_vfprintf(stdout, format, args);
+  va_end(args);
+  return ret;
+}
+
+EXPORT int puts(const char* s) {
+  CHECK_RT("puts");
+  REAL(puts);
+  return real_puts(s);
+}
+
+EXPORT int putchar(int c) {
+  CHECK_RT("putchar");
+  REAL(putchar);
+  return real_putchar(c);
+}
+
+EXPORT int fputs(const char* s, FILE* fp) {
+  CHECK_RT("fputs");
+  REAL(fputs);
+  return real_fputs(s, fp);
+}
+
+EXPORT int fputc(int c, FILE* fp) {
+  CHECK_RT("fputc");
+  REAL(fputc);
+  return real_fputc(c, fp);
+}
+
+EXPORT size_t fwrite(const void* buf, size_t size, size_t n, FILE* fp) {
+  CHECK_RT("fwrite");
+  REAL(fwrite);
+  return real_fwrite(buf, size, n, fp);
+}
@@ -0,0 +1,22 @@
+// Hooks for the RT-safety checker (rtcheck.c).
+//
+// The wrappers and the LV2 run() functions bracket everything they do on the
+// audio thread with RTCHECK_ENTER and RTCHECK_LEAVE. In a normal build these
+// are empty. With -DRTCHECK they call into rtcheck.c, which then reports
+// every allocation, lock, file or console access made by the current thread
+// until the matching RTCHECK_LEAVE. The hooks are weak, so an LV2 plugin
+// built with -DRTCHECK still loads in a host without rtcheck.so preloaded.
+//
+//   RTCHECK_ENTER("LV2 run");
+//   ...
+//   RTCHECK_LEAVE();
+
+#ifdef RTCHECK
+__attribute__((weak, visibility("default"))) void rtcheck_enter(const char* where);
+__attribute__((weak, visibility("default"))) void rtcheck_leave(void);
+#define RTCHECK_ENTER(where) do { if (rtcheck_enter) rtcheck_enter(where); } while (0)
+#define RTCHECK_LEAVE() do { if (rtcheck_leave) rtcheck_leave(); } while (0)
+#else
+#define RTCHECK_ENTER(where) do { } while (0)
+#define RTCHECK_LEAVE() do { } while (0)
+#endif
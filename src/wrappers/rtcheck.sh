@@ -0,0 +1,79 @@
+#!/bin/sh
+# Runs each %-rtcheck renderer given on the command line (make rtcheck) over
+# a short stimulus and lists the plugins that made RT-unsafe calls.
+#
+# Effects get a second of noise on their first input, synths a chord; both get
+# every CC from 1 to 119 moved twice, so that the parameter updates run as
+# well. Backtrace lines into the renderer are resolved with addr2line when it
+# is installed.
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+bytes() {
+  for b; do printf "\\$(printf %03o "$b")"; done
+}
+
+le32() {
+  bytes $(($1 & 255)) $(($1 >> 8 & 255)) $(($1 >> 16 & 255)) $(($1 >> 24 & 255))
+}
+
+be32() {
+  bytes $(($1 >> 24 & 255)) $(($1 >> 16 & 255)) $(($1 >> 8 & 255)) $(($1 & 255))
+}
+
+# 1 s of 16-bit mono noise at 48 kHz
+{
+  printf RIFF; le32 96036; printf WAVEfmt' '; le32 16
+  bytes 1 0 1 0; le32 48000; le32 96000; bytes 2 0 16 0
+  printf data; le32 96000
+  head -c 96000 /dev/urandom
+} > "$dir/noise.wav"
+
+# A chord, two CC sweeps 4 ticks apart, note offs; 480 ticks per beat
+{
+  bytes 0 0x90 60 100 0 0x90 64 100 0 0x90 67 100
+  for value in 100 20; do
+    cc=1
+    while [ $cc -le 119 ]; do
+      bytes 4 0xb0 $cc $value
+      cc=$((cc + 1))
+    done
+  done
+  bytes 0 0x80 60 0 0 0x80 64 0 0 0x80 67 0
+  bytes 0 0xff 0x2f 0
+} > "$dir/track"
+{
+  printf MThd; be32 6; bytes 0 0 0 1 1 0xe0
+  printf MTrk; be32 $(wc -c < "$dir/track")
+  cat "$dir/track"
+} > "$dir/stimulus.mid"
+
+failed=
+for renderer; do
+  ./$renderer -i "$dir/noise.wav" -m "$dir/stimulus.mid" -t 1 -o "$dir/out.wav" \
+    > /dev/null 2> "$dir/log"
+  status=$?
+  if [ $status -ne 0 ] || grep -q '^rtcheck:' "$dir/log"; then
+    failed="$failed $renderer"
+  fi
+  while IFS= read -r line; do
+    case "$line" in
+      "./$renderer(+0x"*)
+	offset=${line#*(+}
+	offset=${offset%%)*}
+	if command -v addr2line > /dev/null; then
+	  printf '%s\t%s\n' "$line" "$(addr2line -f -p -e ./$renderer $offset)"
+	  continue
+	fi
+	;;
+    esac
+    printf '%s\n' "$line"
+  done < "$dir/log" >&2
+done
+
+if [ -n "$failed" ]; then
+  echo "RT-unsafe:$failed" >&2
+  exit 1
+fi
+echo "No RT-unsafe calls found" >&2
@@ -0,0 +1,78 @@
+// Sleeping for effects whose input is silent and whose tail has died out.
+//
+// A plugin opts in by setting instance->plugin_tail in plugin_init to a
+// function that returns the level of what is still left in it: the peak of
+// its filter state, of its reverb tank, and so on. The wrappers call it only
+// after a block of nframes whose audio inputs were all below TAIL_SILENCE, and
+// instance->wrapper_silent_frames tells how long the input has been silent,
+// for plugins with pure delays that have to drain first. Once the block's
+// output and plugin_tail are both below TAIL_SILENCE, the wrapper sets
+// wrapper_sleeping: from then on, blocks of silent input produce silent
+// output without calling plugin_process, and the first block with input
+// wakes the plugin up. What is cut off is on the order of TAIL_SILENCE, a
+// little more where several parts of the state each stop just below it:
+// 1.3e-6 for reverb.
+//
+// CCs keep being written while the plugin sleeps; wrapper_cc_dispatch passes
+// them on when it wakes up. Plugins without plugin_tail (synths, anything
+// that makes sound on its own) always run.
+//
+// tail_scan is for state too large to look at every block: it scans nframes
+// floats of a buffer per call and reports the peak of the last full sweep and
+// the current one. It starts over at the first silent block after input,
+// since a sweep from before that input has not seen what it left behind.
+
+#include <math.h>
+#include <stdbool.h>
+
+#define TAIL_SILENCE 1e-6f // -120 dB
+
+static inline float tail_peak(const float* buf, int n) {
+  float peak = 0;
+  FOR(i, n) peak = fmaxf(peak, fabsf(buf[i]));
+  return peak;
+}
+
+// Called by the wrappers after each block the plugin ran. Checking the
+// output as well catches a ringing filter whose state happens to be near a
+// zero crossing at the end of the block.
+static inline void tail_update(struct instance* instance, bool inputs_silent, bool outputs_silent, int nframes) {
+  if (!inputs_silent) {
+    instance->wrapper_silent_frames = 0;
+    return;
+  }
+  instance->wrapper_silent_frames += nframes;
+  // plugin_tail runs even while the output is loud, so that it sees the
+  // first silent block (see tail_scan)
+  float tail = instance->plugin_tail(instance, nframes);
+  if (outputs_silent && tail < TAIL_SILENCE) instance->wrapper_sleeping = 1;
+}
+
+struct tail_scan {
+  int pos;
+  float peak;      // of the current sweep
+  float last_peak; // of the last full sweep
+};
+
+static inline void tail_scan_init(struct tail_scan* s) {
+  s->pos = 0;
+  s->peak = 0;
+  s->last_peak = 1; // no full sweep yet
+}
+
+static inline float tail_scan(struct tail_scan* s, struct instance* instance, const float* buf, int len, int nframes) {
+  if (instance->wrapper_silent_frames <= nframes) tail_scan_init(s);
+  if (s->pos >= len) s->pos = 0; // the buffer shrank
+  while (nframes > 0) {
+    int n = len - s->pos < nframes ? len - s->pos : nframes;
+    s->peak = fmaxf(s->peak, tail_peak(buf + s->pos, n));
+    s->pos += n;
+    nframes -= n;
+    if (s->pos == len) {
+      s->last_peak = s->peak;
+      s->peak = 0;
+      s->pos = 0;
+    }
+  }
+  return fmaxf(s->last_peak, s->peak);
+}
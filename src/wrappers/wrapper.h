@@ -2,13 +2,52 @@
 #define CHECK(prop, msg) if (!(prop)) { fprintf(stderr, "Error: " msg "\n"); exit(1); }
 
 struct instance {
+  // Wrappers only write wrapper_cc through wrapper_set_cc, which counts the
+  // changes in wrapper_cc_generation.
   char wrapper_cc[128];
+  unsigned wrapper_cc_generation;
+  unsigned wrapper_cc_seen; // the generation plugin_cc_changed last saw
   float freq[128];
   float cents[128];
+  // Set by the wrapper: add gain * output to the output buffers instead of
+  // overwriting them. Only used when the plugin sets plugin_can_run_adding.
+  char wrapper_run_adding;
+  float wrapper_run_adding_gain;
+  char plugin_can_run_adding;
+  // Set by the plugin: the most frames it wants per plugin_process call, or 0
+  // for any. The wrappers split longer blocks on a grid of this size counted
+  // from the start of the host's block, so the sub-blocks stay aligned.
+  int plugin_block_size;
+  // Set by effect plugins that may sleep on silence, see tail.h.
+  float (*plugin_tail)(struct instance* instance, int nframes);
+  char wrapper_sleeping;
+  long wrapper_silent_frames;
+  // Set by the plugin: recomputes whatever it derives from wrapper_cc.
+  // wrapper_cc_dispatch calls it before plugin_process when a CC changed,
+  // so plugins that set it call it once themselves at the end of plugin_init.
+  void (*plugin_cc_changed)(struct instance* instance);
   void *plugin;
   void *wrapper;
 };
 
+// A CC may be changed from another thread than the process thread: the
+// generation is bumped after the value is stored, so the process thread sees
+// the new value no later than the block after.
+static inline void wrapper_set_cc(struct instance* instance, int cc_number, int value) {
+  char cc = value;
+  if (instance->wrapper_cc[cc_number] == cc) return;
+  instance->wrapper_cc[cc_number] = cc;
+  __atomic_fetch_add(&instance->wrapper_cc_generation, 1, __ATOMIC_RELEASE);
+}
+
+// Called by the wrappers on the process thread right before plugin_process.
+static inline void wrapper_cc_dispatch(struct instance* instance) {
+  unsigned generation = __atomic_load_n(&instance->wrapper_cc_generation, __ATOMIC_ACQUIRE);
+  if (generation == instance->wrapper_cc_seen) return;
+  instance->wrapper_cc_seen = generation;
+  if (instance->plugin_cc_changed) instance->plugin_cc_changed(instance);
+}
+
 extern void wrapper_add_cc(struct instance* instance, int cc_number, const char* display_name, const char* persist_name, int default_value);
 extern void wrapper_add_audio_input(struct instance* instance, const char* name, float** buf);
 extern void wrapper_add_audio_output(struct instance* instance, const char* name, float** buf);
@@ -29,3 +68,32 @@ extern void plugin_process(struct instance* instance, int nframes);
 extern const char* plugin_name;
 extern const char* plugin_persistence_name;
 extern const unsigned plugin_ladspa_unique_id;
+
+// The ports plugin_init registers, in the same order, for hosts that list
+// plugins without instantiating them (the LADSPA descriptor). Plugins built
+// into mjack-ladspa.so define the table with PLUGIN_STATIC_PORTS; the LADSPA
+// wrapper checks every instance's registration against it.
+enum plugin_port_kind {
+  PLUGIN_PORT_AUDIO_INPUT,
+  PLUGIN_PORT_AUDIO_OUTPUT,
+  PLUGIN_PORT_MIDI_INPUT,
+  PLUGIN_PORT_CC,
+};
+
+struct plugin_port {
+  enum plugin_port_kind kind;
+  const char* name;
+  int cc_number; // -1 for audio and MIDI ports
+};
+
+#define PLUGIN_AUDIO_INPUT(name) { PLUGIN_PORT_AUDIO_INPUT, name, -1 }
+#define PLUGIN_AUDIO_OUTPUT(name) { PLUGIN_PORT_AUDIO_OUTPUT, name, -1 }
+#define PLUGIN_MIDI_INPUT(name) { PLUGIN_PORT_MIDI_INPUT, name, -1 }
+#define PLUGIN_CC(cc_number, name) { PLUGIN_PORT_CC, name, cc_number }
+
+#define PLUGIN_STATIC_PORTS(...)					\
+  const struct plugin_port plugin_static_ports[] = { __VA_ARGS__ };	\
+  const int plugin_num_static_ports = sizeof(plugin_static_ports) / sizeof(plugin_static_ports[0]);
+
+extern const struct plugin_port plugin_static_ports[];
+extern const int plugin_num_static_ports;